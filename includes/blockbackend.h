@@ -0,0 +1,230 @@
+//
+//  blockbackend.h
+//  myfs
+//
+
+#ifndef blockBackend_h
+#define blockBackend_h
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <vector>
+
+#define BD_BLOCK_SIZE 512
+
+/**
+ * A BlockBatch collects block transfers which are handed to BlockBackend::submit() together.
+ * Its block size must match the block size of the BlockBackend. Buffers passed to a batch must stay valid
+ * until the batch has been submitted.
+ */
+class BlockBatch {
+private:
+    friend class BlockBackend;
+    friend class BlockDevice;
+
+    struct Request {
+        bool write;
+        uint64_t firstBlock;
+        size_t firstIov;
+        int iovcnt;
+    };
+
+    u_int32_t blockSize;
+    std::vector<Request> requests;
+    std::vector<struct iovec> iovs;
+
+    void queue(bool write, uint64_t firstBlock, const struct iovec *iov, int iovcnt);
+
+public:
+    BlockBatch(u_int32_t blockSize = BD_BLOCK_SIZE);
+
+    /**
+     * This method queues a read of count consecutive blocks starting at firstBlock into buffer.
+     */
+    void queueRead(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method queues a write of count consecutive blocks starting at firstBlock from buffer.
+     */
+    void queueWrite(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method queues a scatter read of consecutive blocks starting at firstBlock, see BlockBackend::readv().
+     */
+    void queueReadv(uint64_t firstBlock, const struct iovec *iov, int iovcnt);
+
+    /**
+     * This method queues a gather write of consecutive blocks starting at firstBlock, see BlockBackend::writev().
+     */
+    void queueWritev(uint64_t firstBlock, const struct iovec *iov, int iovcnt);
+
+    /**
+     * This method returns the number of queued requests.
+     * @return number of requests
+     */
+    unsigned int size(void);
+
+    /**
+     * This method removes all queued requests.
+     */
+    void clear(void);
+};
+
+/**
+ * A BlockBackend stores fixed size blocks, MyFS and the BlockCache only depend on this interface.
+ * Implementations are the BlockDevice, which keeps the blocks in a container file and may map it or use
+ * io_uring, and the RamBlockDevice, which keeps them in memory.
+ * An implementation provides at least open, create, close, readv, writev and getSize. Single and multi block
+ * transfers are built on readv and writev, batches are executed request by request unless submit is overridden.
+ * Block numbers and byte offsets are 64 bit wide.
+ */
+class BlockBackend {
+protected:
+    uint32_t blockSize;
+
+public:
+    BlockBackend(u_int32_t blockSize = BD_BLOCK_SIZE);
+    virtual ~BlockBackend();
+
+    /**
+     * This method changes the block size, it must not run concurrently with any other call.
+     * @param blockSize multiple of 512
+     */
+    void resize(u_int32_t blockSize);
+
+    /**
+     * This method opens existing blocks.
+     * @param path container file
+     * @param flags implementation specific flags
+     * @return 0 for success or a negative error value
+     */
+    virtual int open(const char *path, int flags = 0) = 0;
+
+    /**
+     * This method creates empty storage, existing blocks are dropped.
+     * @param path container file
+     * @param flags implementation specific flags
+     * @return 0 for success or a negative error value
+     */
+    virtual int create(const char *path, int flags = 0) = 0;
+
+    /**
+     * This method closes the storage.
+     * @return 0 for success or a negative error value
+     */
+    virtual int close() = 0;
+
+    /**
+     * This method tells if transfers bypass the host page cache.
+     * @return true for O_DIRECT transfers
+     */
+    virtual bool isDirect(void);
+
+    int read(uint64_t blockNo, char *buffer);
+    int write(uint64_t blockNo, char *buffer);
+
+    /**
+     * This method reads count consecutive blocks starting at firstBlock into buffer with a single request.
+     * Blocks which have never been written are returned zero filled.
+     * @param firstBlock first block to read
+     * @param count number of blocks
+     * @param buffer must hold count * blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int readBlocks(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method writes count consecutive blocks starting at firstBlock from buffer with a single request.
+     * @param firstBlock first block to write
+     * @param count number of blocks
+     * @param buffer must hold count * blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int writeBlocks(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method reads consecutive blocks starting at firstBlock into the buffers of iov (scatter).
+     * The length of every buffer must be a multiple of the block size.
+     * @param firstBlock first block to read
+     * @param iov buffers
+     * @param iovcnt number of buffers
+     * @return 0 for success or a negative error value
+     */
+    virtual int readv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) = 0;
+
+    /**
+     * This method writes the buffers of iov to consecutive blocks starting at firstBlock (gather).
+     * The length of every buffer must be a multiple of the block size.
+     * @param firstBlock first block to write
+     * @param iov buffers
+     * @param iovcnt number of buffers
+     * @return 0 for success or a negative error value
+     */
+    virtual int writev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) = 0;
+
+    /**
+     * This method executes all requests of a batch and waits for their completion. The batch is cleared.
+     * @param batch queued requests
+     * @return 0 for success or the first negative error value of a request
+     */
+    virtual int submit(BlockBatch *batch);
+
+    /**
+     * This method tells if batches are submitted through io_uring.
+     * @return true if io_uring is used
+     */
+    virtual bool hasRing(void);
+
+    /**
+     * This method makes the blocks addressable through getBlockPointer().
+     * @return 0 for success or a negative error value, -EINVAL if the implementation cannot do this
+     */
+    virtual int map();
+
+    /**
+     * This method undoes map().
+     * @return 0 for success or a negative error value
+     */
+    virtual int unmap();
+
+    /**
+     * This method returns a pointer to the memory of a block, writes through it change the block.
+     * @param blockNo block number
+     * @return pointer to the block or NULL if the block is not addressable
+     */
+    virtual char *getBlockPointer(uint64_t blockNo);
+
+    /**
+     * This method tells that count consecutive blocks starting at firstBlock will be read soon, so the storage may
+     * start reading them in the background. It returns immediately, the default does nothing.
+     * @param firstBlock first block
+     * @param count number of blocks
+     * @return 0 for success or a negative error value
+     */
+    virtual int willNeed(uint64_t firstBlock, uint64_t count);
+
+    /**
+     * This method releases the space of count consecutive blocks starting at firstBlock, the released blocks
+     * read as zeros afterwards.
+     * @param firstBlock first block
+     * @param count number of blocks
+     * @return 0 for success, -EOPNOTSUPP if space cannot be released or another negative error value
+     */
+    virtual int discard(uint64_t firstBlock, uint64_t count);
+
+    /**
+     * This method makes all written blocks durable.
+     * @return 0 for success or a negative error value
+     */
+    virtual int sync();
+
+    /**
+     * This method returns the current size of the storage in bytes.
+     * @return size
+     */
+    virtual uint64_t getSize() = 0;
+};
+
+#endif /* blockBackend_h */
@@ -0,0 +1,206 @@
+//
+//  blockcache.h
+//  myfs
+//
+
+#ifndef blockCache_h
+#define blockCache_h
+
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include <unordered_map>
+#include <vector>
+
+#include "blockbackend.h"
+
+// a block cache holds at least this many blocks, whatever its memory budget is
+#define BC_MIN_BLOCKS 16
+// a dirty block which is evicted is written back together with the dirty blocks among this many slots the clock
+// hand reaches next, starting with its own slot
+#define BC_EVICT_WRITE_BACK_SLOTS 64
+// prefetch requests queued for the prefetch thread and not yet read are dropped beyond this many blocks
+#define BC_PREFETCH_QUEUE_BLOCKS 4096
+
+/**
+ * A BlockCache keeps recently used blocks of a BlockBackend in memory.
+ * Its size follows from a memory budget in bytes. Blocks are replaced with the CLOCK algorithm: every access sets
+ * a reference bit, the clock hand evicts the first block whose bit is clear and clears the bits it passes.
+ * Writes only change the cached block and mark it dirty (write-back). flush() writes every dirty block to the
+ * BlockBackend. Evicting a dirty block writes it together with the dirty blocks the clock hand reaches next, so an
+ * eviction writes at most BC_EVICT_WRITE_BACK_SLOTS blocks. Both write their blocks in one batch sorted by block
+ * number, so that neighbouring blocks are merged into one request.
+ * Misses of a multi block read are read with one batch directly into the buffers of the caller.
+ * Blocks which are likely needed soon can be prefetched, prefetchAsync() hands them to a background thread.
+ * Prefetched blocks enter the cache with a clear reference bit, so unused ones are the first to be replaced.
+ * A BlockCache is thread safe. All transfers of the cached blocks have to go through the cache.
+ */
+class BlockCache {
+private:
+    struct Slot {
+        uint64_t blockNo;
+        bool valid;
+        bool dirty;
+        bool referenced;
+    };
+
+    BlockBackend *blockDevice;
+    uint32_t blockSize;
+    unsigned int slotCount;
+    Slot *slots;
+    char *data;
+    std::unordered_map<uint64_t, unsigned int> index;
+    unsigned int hand;
+    pthread_mutex_t lock;
+    // counts dirty insertions, a prefetch discards its blocks if a write happened while they were read
+    uint64_t writes;
+
+    pthread_t prefetchThread;
+    bool prefetchRunning;
+    bool prefetchStopping;
+    std::vector<uint64_t> prefetchQueue;
+    pthread_mutex_t prefetchLock;
+    pthread_cond_t prefetchCondition;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t writeBacks;
+    uint64_t prefetched;
+
+    char *slotData(unsigned int slot);
+    int lookup(uint64_t blockNo);
+    int evict(unsigned int *slot);
+    int insert(uint64_t blockNo, const char *buffer, bool dirty);
+    int flushLocked(void);
+    int writeBackLocked(std::vector<unsigned int> &dirty);
+    static void *prefetchMain(void *cache);
+
+public:
+    /**
+     * Constructor.
+     * @param blockDevice cached block backend, its block size must be blockSize
+     * @param blockSize block size
+     * @param budget memory used for cached blocks in bytes
+     */
+    BlockCache(BlockBackend *blockDevice, uint32_t blockSize, size_t budget);
+
+    /**
+     * Destructor, stops the prefetch thread. Dirty blocks are not written back, call flush() before.
+     */
+    ~BlockCache();
+
+    /**
+     * This method reads a block through the cache.
+     * @param blockNo block number
+     * @param buffer receives blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int read(uint64_t blockNo, char *buffer);
+
+    /**
+     * This method writes a block into the cache and marks it dirty.
+     * @param blockNo block number
+     * @param buffer holds blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int write(uint64_t blockNo, const char *buffer);
+
+    /**
+     * This method reads several blocks through the cache. All misses are read with one batch.
+     * @param blocks block numbers
+     * @param buffers one buffer of blockSize bytes for every block
+     * @param count number of blocks
+     * @return 0 for success or a negative error value
+     */
+    int readBlocks(const uint64_t *blocks, char **buffers, unsigned int count);
+
+    /**
+     * This method writes several blocks into the cache and marks them dirty.
+     * @param blocks block numbers
+     * @param buffers one buffer of blockSize bytes for every block
+     * @param count number of blocks
+     * @return 0 for success or a negative error value
+     */
+    int writeBlocks(const uint64_t *blocks, char **buffers, unsigned int count);
+
+    /**
+     * This method reads count consecutive blocks starting at firstBlock through the cache.
+     * @param firstBlock first block
+     * @param count number of blocks
+     * @param buffer must hold count * blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int readBlocks(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method writes count consecutive blocks starting at firstBlock into the cache.
+     * @param firstBlock first block
+     * @param count number of blocks
+     * @param buffer must hold count * blockSize bytes
+     * @return 0 for success or a negative error value
+     */
+    int writeBlocks(uint64_t firstBlock, uint64_t count, char *buffer);
+
+    /**
+     * This method tells if a block is held by the cache.
+     * @param blockNo block number
+     * @return true if the block is cached
+     */
+    bool contains(uint64_t blockNo);
+
+    /**
+     * This method drops cached copies of count consecutive blocks starting at firstBlock, dirty copies are not
+     * written back. It is used before blocks are written to the BlockBackend without the cache.
+     * @param firstBlock first block
+     * @param count number of blocks
+     */
+    void invalidate(uint64_t firstBlock, uint64_t count);
+
+    /**
+     * This method reads the blocks which are not cached yet with one batch and adds them to the cache.
+     * The cache lock is not held while the blocks are read.
+     * @param blocks block numbers
+     * @param count number of blocks
+     * @return 0 for success or a negative error value
+     */
+    int prefetch(const uint64_t *blocks, unsigned int count);
+
+    /**
+     * This method queues blocks for the prefetch thread and returns immediately.
+     * @param blocks block numbers
+     * @param count number of blocks
+     */
+    void prefetchAsync(const uint64_t *blocks, unsigned int count);
+
+    /**
+     * This method writes all dirty blocks to the BlockBackend.
+     * @return 0 for success or a negative error value
+     */
+    int flush(void);
+
+    /**
+     * This method returns the number of blocks served from the cache.
+     * @return hits
+     */
+    uint64_t getHits(void);
+
+    /**
+     * This method returns the number of blocks which had to be read from the BlockBackend.
+     * @return misses
+     */
+    uint64_t getMisses(void);
+
+    /**
+     * This method returns the number of dirty blocks written to the BlockBackend.
+     * @return written back blocks
+     */
+    uint64_t getWriteBacks(void);
+
+    /**
+     * This method returns the number of blocks added to the cache by prefetching.
+     * @return prefetched blocks
+     */
+    uint64_t getPrefetched(void);
+};
+
+#endif /* blockCache_h */
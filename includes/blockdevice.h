@@ -6,31 +6,177 @@
 //  Copyright © 2017 Oliver Waldhorst. All rights reserved.
 //
 
-// DO NOT EDIT THIS FILE!!!
-
 #ifndef blockDevice_h
 #define blockDevice_h
 
 #include <stdio.h>
 #include <cstdint>
+#include <pthread.h>
+#include <sys/uio.h>
+#include <vector>
+
+#include "blockbackend.h"
+#include "blockring.h"
+
+// the mapping of a mapped container file grows in steps of this size
+#define BD_MAP_GROW_SIZE (1024 * 1024)
+// number of requests the io_uring submission queue holds
+#define BD_RING_ENTRIES 64
+
+// open/create flag: bypass the host page cache with O_DIRECT
+#define BD_DIRECT_IO 1
+// alignment of buffers, file offsets and lengths for O_DIRECT transfers
+#define BD_DIRECT_ALIGNMENT 4096
+// size and number of the pooled O_DIRECT bounce buffers
+#define BD_DIRECT_BUFFER_SIZE (128 * 1024)
+#define BD_DIRECT_BUFFERS 8
 
-#define BD_BLOCK_SIZE 512
+// the host releases space in whole units of this size, discard() zeroes the rest of a range
+#define BD_DISCARD_ALIGNMENT 4096
 
-class BlockDevice {
+/**
+ * An AlignedBufferPool hands out BD_DIRECT_ALIGNMENT aligned buffers of BD_DIRECT_BUFFER_SIZE bytes.
+ * It keeps up to BD_DIRECT_BUFFERS released buffers for reuse and is thread safe.
+ */
+class AlignedBufferPool {
+private:
+    std::vector<char *> buffers;
+    pthread_mutex_t lock;
+
+public:
+    AlignedBufferPool();
+
+    ~AlignedBufferPool();
+
+    /**
+     * This method returns a buffer from the pool or allocates a new one if the pool is empty.
+     * @return aligned buffer or NULL if no memory is left
+     */
+    char *get(void);
+
+    /**
+     * This method returns a buffer to the pool.
+     * @param buffer from get()
+     */
+    void put(char *buffer);
+};
+
+/**
+ * A BlockDevice stores fixed size blocks in a container file.
+ * Block numbers and byte offsets are 64 bit wide, so containers may grow beyond 4 GiB.
+ * All block transfers use positional I/O (pread/pwrite and their vectored variants) and keep no file offset,
+ * so read, write and getSize may be called concurrently from several threads. open, create, close, resize, map and
+ * unmap must not run concurrently with any other call.
+ * After map() the container file is memory mapped: transfers become memcpy calls on the mapping and
+ * getBlockPointer() hands out pointers into it. A write behind the end of the mapping may move it, so such a
+ * pointer is only valid while no other thread writes to the container.
+ * Batches of transfers are submitted through io_uring with one system call when the kernel supports it,
+ * otherwise they are executed one by one with positional I/O.
+ * Opened with BD_DIRECT_IO the container bypasses the host page cache. Transfers which do not meet the O_DIRECT
+ * alignment rules are bounced through pooled aligned buffers. Writing partial sectors reads, modifies and writes
+ * them exclusively, so no concurrent write to the same sectors is lost.
+ */
+class BlockDevice : public BlockBackend {
 private:
-    uint32_t blockSize;
     int contFile;
-    uint32_t size;
+    bool mapped;
+    char *mapping;
+    size_t mappingSize;
+    pthread_rwlock_t mappingLock;
+    BlockRing *ring;
+    pthread_mutex_t ringLock;
+    bool direct;
+    AlignedBufferPool directBuffers;
+    // held for reading by aligned O_DIRECT writes and for writing by the read-modify-write of partial sectors
+    pthread_rwlock_t directLock;
+
+    int openContainer(const char *path, int openFlags, int flags);
+    bool isDirectAligned(off_t pos, const struct iovec *iov, int iovcnt);
+    int transferDirect(bool write, off_t pos, const struct iovec *iov, int iovcnt);
+    int growMapping(size_t minSize);
+    void setupRing(void);
+    int submitRing(BlockBatch *batch);
     
 public:
-    BlockDevice(u_int32_t blockSize = 512);
-    void resize(u_int32_t blockSize);
-    int open(const char* path);
-    int create(const char* path);
-    int close();
-    int read(u_int32_t blockNo, char *buffer);
-    int write(u_int32_t blockNo, char *buffer);
-    uint32_t getSize();
+    BlockDevice(u_int32_t blockSize = BD_BLOCK_SIZE);
+    ~BlockDevice() override;
+    int open(const char* path, int flags = 0) override;
+    int create(const char* path, int flags = 0) override;
+
+    /**
+     * This method tells if the container file has been opened with O_DIRECT.
+     * @return true if the host page cache is bypassed
+     */
+    bool isDirect(void) override;
+    int close() override;
+
+    /**
+     * This method reads consecutive blocks with preadv, blocks beyond the end of the container file are returned
+     * zero filled.
+     */
+    int readv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) override;
+
+    /**
+     * This method writes consecutive blocks with pwritev, the container file grows as needed.
+     */
+    int writev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) override;
+
+    /**
+     * This method executes all requests of a batch. With io_uring the requests are submitted with one system call
+     * and their completions are reaped together.
+     */
+    int submit(BlockBatch *batch) override;
+
+    /**
+     * This method tells if batches are submitted through io_uring.
+     * @return true if io_uring is used, false if batches fall back to positional I/O
+     */
+    bool hasRing(void) override;
+
+    /**
+     * This method maps the opened container file into memory. Writes behind the end of the mapping grow the
+     * container file and the mapping. A container opened with BD_DIRECT_IO cannot be mapped.
+     * @return 0 for success or a negative error value
+     */
+    int map() override;
+
+    /**
+     * This method removes the mapping, afterwards blocks are transferred with pread/pwrite again.
+     * @return 0 for success or a negative error value
+     */
+    int unmap() override;
+
+    /**
+     * This method returns a pointer to a block inside the mapping. The pointer stays valid until the next
+     * write which grows the container or until unmap(), so it must not be used while another thread writes.
+     * @param blockNo block number
+     * @return pointer to the block or NULL if the container is not mapped or the block lies behind the mapping
+     */
+    char *getBlockPointer(uint64_t blockNo) override;
+
+    /**
+     * This method starts reading blocks into the host page cache, with madvise on the mapping or with
+     * posix_fadvise without one.
+     */
+    int willNeed(uint64_t firstBlock, uint64_t count) override;
+
+    /**
+     * This method punches a hole into the container file with fallocate. The whole BD_DISCARD_ALIGNMENT units of
+     * the range are released, the rest of the range is zeroed, so callers should discard whole units.
+     */
+    int discard(uint64_t firstBlock, uint64_t count) override;
+
+    /**
+     * This method flushes all written blocks to the container file (msync for a mapped container).
+     * @return 0 for success or a negative error value
+     */
+    int sync() override;
+
+    /**
+     * This method returns the current size of the container file in bytes.
+     * @return size of the container file
+     */
+    uint64_t getSize() override;
 };
 
 #endif /*blockDevice_h*/
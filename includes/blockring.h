@@ -0,0 +1,100 @@
+//
+//  blockring.h
+//  myfs
+//
+
+#ifndef blockRing_h
+#define blockRing_h
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * A BlockRing is a minimal io_uring submission/completion queue pair used by the BlockDevice to hand many
+ * block transfers to the kernel with a single system call.
+ * On systems without io_uring setup() fails and the BlockDevice uses positional I/O instead.
+ * A BlockRing is not thread safe, the BlockDevice serializes its use.
+ */
+class BlockRing {
+private:
+    int ringFd;
+    unsigned int entries;
+    // prepared requests not yet submitted, submitted requests not yet reaped
+    unsigned int pending;
+    unsigned int inFlight;
+
+    // submission queue
+    void *sqRing;
+    size_t sqRingSize;
+    unsigned int *sqHead;
+    unsigned int *sqTail;
+    unsigned int *sqMask;
+    unsigned int *sqArray;
+    void *sqes;
+    size_t sqesSize;
+
+    // completion queue
+    void *cqRing;
+    size_t cqRingSize;
+    unsigned int *cqHead;
+    unsigned int *cqTail;
+    unsigned int *cqMask;
+    void *cqes;
+
+public:
+    BlockRing();
+
+    ~BlockRing();
+
+    /**
+     * This method creates the rings in the kernel.
+     * @param entries size of the submission queue
+     * @return 0 for success or a negative error value if io_uring is not available
+     */
+    int setup(unsigned int entries);
+
+    /**
+     * This method returns the number of requests which can be prepared before they have to be submitted.
+     * @return entries
+     */
+    unsigned int getEntries(void);
+
+    /**
+     * This method prepares a vectored read or write request in the submission queue.
+     * The buffers described by iov must stay valid until the request has been reaped.
+     * @param write true for a write request
+     * @param fd file descriptor
+     * @param iov buffers
+     * @param iovcnt number of buffers
+     * @param offset byte offset in the file
+     * @param userData returned with the completion of this request
+     * @return 0 for success or -EBUSY if the submission queue is full
+     */
+    int prepare(bool write, int fd, const struct iovec *iov, int iovcnt, off_t offset, uint64_t userData);
+
+    /**
+     * This method submits all prepared requests and waits until waitCount completions are available.
+     * @param waitCount number of completions to wait for
+     * @return 0 for success or a negative error value
+     */
+    int submitAndWait(unsigned int waitCount);
+
+    /**
+     * This method removes one completion from the completion queue.
+     * @param userData of the completed request
+     * @param result of the completed request, transferred bytes or a negative error value
+     * @return 0 for success or -EAGAIN if no completion is available
+     */
+    int reap(uint64_t *userData, int *result);
+
+    /**
+     * This method withdraws the prepared requests which have not been submitted and waits for all submitted
+     * requests, their completions are discarded. Afterwards the kernel no longer uses any buffer of a request.
+     * @return 0 for success or a negative error value if the ring cannot be waited for
+     */
+    int drain(void);
+};
+
+#endif /* blockRing_h */
@@ -0,0 +1,103 @@
+//
+//  directory.h
+//  myfs
+//
+
+#ifndef directory_h
+#define directory_h
+
+#include <cstddef>
+#include <cstdint>
+
+// root index of the root directory, it follows the inode table and is its own parent
+#define ROOT_DIRECTORY 1
+// maximum number of directory blocks of a directory
+#define DIRECTORY_MAX_BUCKETS 65536
+// number of directories kept by the dentry cache, it is cleared when it grows larger
+#define DENTRY_CACHE_SIZE 4096
+
+// size of the header starting every directory block, the number of entries and the number of used bytes including
+// the header as 32 bit numbers
+#define DIRECTORY_HEADER_SIZE 8
+
+/**
+ * A DirectoryBlock accesses one block of a directory in a buffer. The data blocks of a directory form a hash table
+ * of buckets, a power of two in number, and an entry is stored in the block selected by the low bits of the hash of
+ * its name, so a lookup reads one block. When a block overflows the directory doubles its number of blocks and
+ * distributes its entries anew.
+ * An entry is packed behind the header as root index (4 bytes), name length (1 byte) and the name without
+ * terminating zero. The header and the root indexes are stored in little-endian byte order (see diskformat.h).
+ */
+class DirectoryBlock {
+private:
+    char *data;
+    unsigned int blockSize;
+
+    uint32_t getUsed(void);
+    void setHeader(uint32_t count, uint32_t used);
+    unsigned int findOffset(const char *name, size_t length);
+
+public:
+    /**
+     * Constructor
+     * @param data buffer of blockSize bytes holding the block
+     * @param blockSize block size
+     */
+    DirectoryBlock(char *data, unsigned int blockSize);
+
+    /**
+     * This method hashes a file name, the hash selects the directory block of the name.
+     * @param name file name, not necessarily zero terminated
+     * @param length length of the name
+     * @return hash
+     */
+    static uint32_t hashName(const char *name, size_t length);
+
+    /**
+     * This method removes all entries.
+     */
+    void clear(void);
+
+    /**
+     * This method returns the number of entries.
+     * @return count
+     */
+    unsigned int getCount(void);
+
+    /**
+     * This method looks up a file name.
+     * @param name file name, not necessarily zero terminated
+     * @param length length of the name
+     * @return root index of the file or -1 if the block has no such entry
+     */
+    int find(const char *name, size_t length);
+
+    /**
+     * This method adds an entry.
+     * @param name file name, not necessarily zero terminated
+     * @param length length of the name
+     * @param rootIndex root index of the file
+     * @return true for success, false if the block has no room left
+     */
+    bool insert(const char *name, size_t length, int rootIndex);
+
+    /**
+     * This method removes an entry.
+     * @param name file name, not necessarily zero terminated
+     * @param length length of the name
+     * @return true if the entry has been removed, false if the block has no such entry
+     */
+    bool remove(const char *name, size_t length);
+
+    /**
+     * This method iterates over the entries.
+     * @param offset 0 for the first entry, it is advanced to the next entry
+     * @param rootIndex receives the root index of the entry
+     * @param name receives a pointer to the name in the buffer, it is not zero terminated
+     * @param length receives the length of the name
+     * @return true for an entry, false behind the last entry
+     */
+    bool next(unsigned int *offset, int *rootIndex, const char **name, size_t *length);
+};
+
+#endif /* directory_h */
@@ -0,0 +1,79 @@
+//
+//  diskformat.h
+//  myfs
+//
+
+#ifndef diskformat_h
+#define diskformat_h
+
+#include <cstdint>
+
+// magic number at the start of the SuperBlock, "MYFS" in little-endian byte order
+#define FORMAT_MAGIC 0x5346594d
+// version of the on-disk format written by this file system. Containers of an older version are read, fields
+// added since then get their defaults. Containers of a newer version are refused.
+// 1: first version
+// 2: inode flags, inline data
+// 3: little-endian directory entries and journal descriptors, identical to version 2 on little-endian hosts
+#define FORMAT_VERSION 3
+
+/**
+ * The SuperBlock, the inodes, the directory blocks and the journal descriptors are stored field by field in
+ * little-endian byte order, independent of the compiler's padding and the width of time_t. A field added later is
+ * appended behind the existing fields of its record, so the records of older containers stay readable.
+ * Every encode function stores a value at position and returns the position behind it, every decode function
+ * reads a value at position and returns the position behind it.
+ */
+inline char *encodeUInt32(char *position, uint32_t value) {
+    for (int i = 0; i < 4; i++) {
+        position[i] = (char) (value >> (8 * i));
+    }
+    return position + 4;
+}
+
+inline char *encodeUInt64(char *position, uint64_t value) {
+    for (int i = 0; i < 8; i++) {
+        position[i] = (char) (value >> (8 * i));
+    }
+    return position + 8;
+}
+
+inline const char *decodeUInt32(const char *position, uint32_t *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        *value |= (uint32_t) (unsigned char) position[i] << (8 * i);
+    }
+    return position + 4;
+}
+
+inline const char *decodeUInt64(const char *position, uint64_t *value) {
+    *value = 0;
+    for (int i = 0; i < 8; i++) {
+        *value |= (uint64_t) (unsigned char) position[i] << (8 * i);
+    }
+    return position + 8;
+}
+
+inline char *encodeInt32(char *position, int32_t value) {
+    return encodeUInt32(position, (uint32_t) value);
+}
+
+inline char *encodeInt64(char *position, int64_t value) {
+    return encodeUInt64(position, (uint64_t) value);
+}
+
+inline const char *decodeInt32(const char *position, int32_t *value) {
+    uint32_t field;
+    position = decodeUInt32(position, &field);
+    *value = (int32_t) field;
+    return position;
+}
+
+inline const char *decodeInt64(const char *position, int64_t *value) {
+    uint64_t field;
+    position = decodeUInt64(position, &field);
+    *value = (int64_t) field;
+    return position;
+}
+
+#endif /* diskformat_h */
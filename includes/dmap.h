@@ -0,0 +1,96 @@
+//
+//  dmap.h
+//  myfs
+//
+
+#ifndef dMap_h
+#define dMap_h
+
+#include <cstddef>
+#include <cstdint>
+
+#include "myfs-structs.h"
+
+// number of 64 bit words holding one bit per data block
+#define DMAP_WORDS (D_Map_SIZE / 64)
+// number of 64 bit summary words holding one bit per DMap word
+#define DMAP_SUMMARY_WORDS ((DMAP_WORDS + 63) / 64)
+// the bitmap is kept in a buffer of whole BLOCK_SIZE_MAX blocks, so it can be transferred with any block size
+#define DMAP_BUFFER_WORDS ((D_MAP_BYTES + BLOCK_SIZE_MAX - 1) / BLOCK_SIZE_MAX * BLOCK_SIZE_MAX / 8)
+
+/**
+ * The DMap tells which data blocks are used. It stores one bit per data block, a set bit marks a used block,
+ * so a zeroed DMap describes an empty file system.
+ * A summary level holds one bit per 64 bit word of the bitmap which is set while the word has a free block.
+ * Free runs are found with count trailing zeros on the summary and then on the word, a search skips 4096
+ * used blocks per summary word. The FreeExtents are built from these runs and assign all data blocks. The number
+ * of free blocks is kept up to date.
+ * Only the bitmap is stored on the block device, the summary and the free count are rebuilt by load().
+ */
+class DMap {
+private:
+    uint64_t words[DMAP_BUFFER_WORDS];
+    uint64_t summary[DMAP_SUMMARY_WORDS];
+    unsigned int freeCount;
+
+    void updateSummary(unsigned int word);
+    int findFreeBetween(unsigned int from, unsigned int to);
+    unsigned int findUsedFrom(unsigned int from, unsigned int to);
+
+public:
+    /**
+     * Constructor, all data blocks are free.
+     */
+    DMap();
+
+    /**
+     * This method marks all data blocks as free.
+     */
+    void clear(void);
+
+    /**
+     * This method rebuilds the summary and the free count after the bitmap has been read into getData().
+     */
+    void load(void);
+
+    /**
+     * This method returns the bitmap for transfers from and to the block device.
+     * @return bitmap of DMAP_BUFFER_WORDS words
+     */
+    char *getData(void);
+
+    /**
+     * This method tells if a data block is used.
+     * @param block data block number
+     * @return true if the block is used
+     */
+    bool isUsed(unsigned int block);
+
+    /**
+     * This method marks a data block as used.
+     * @param block data block number
+     */
+    void setUsed(unsigned int block);
+
+    /**
+     * This method marks a data block as free.
+     * @param block data block number
+     */
+    void setFree(unsigned int block);
+
+    /**
+     * This method returns the number of free data blocks.
+     * @return free data blocks
+     */
+    unsigned int getFreeCount(void);
+
+    /**
+     * This method finds the next run of free data blocks.
+     * @param from first data block searched
+     * @param length receives the number of free data blocks of the run
+     * @return first data block of the run or -1 if there is no free data block behind from
+     */
+    int findNextFreeRun(unsigned int from, unsigned int *length);
+};
+
+#endif /* dMap_h */
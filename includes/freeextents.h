@@ -0,0 +1,87 @@
+//
+//  freeextents.h
+//  myfs
+//
+
+#ifndef freeExtents_h
+#define freeExtents_h
+
+#include <map>
+#include <set>
+#include <utility>
+
+#include "dmap.h"
+
+// number of free extents behind the goal which are checked for a run near the goal before the best fit is taken
+#define FREE_EXTENTS_GOAL_SEARCH 16
+
+/**
+ * FreeExtents keep the free data blocks of the DMap as extents of consecutive free blocks, indexed by their
+ * first block and by their length. An assignment of count blocks with a goal block first takes the free blocks
+ * starting at the goal, so an append with the block behind the last block of a file as goal extends the file in
+ * place. Otherwise a free extent close behind the goal which holds the remaining blocks is taken, then the
+ * smallest free extent which holds them (best fit). Only if no free extent is large enough the blocks are taken
+ * from the largest free extents.
+ * Released blocks are merged with neighbouring free extents. FreeExtents only live in memory, load() builds them
+ * from the DMap.
+ */
+class FreeExtents {
+private:
+    std::map<unsigned int, unsigned int> byStart;
+    std::set<std::pair<unsigned int, unsigned int> > byLength;
+    unsigned int freeCount;
+
+    void insert(unsigned int first, unsigned int count);
+    void take(unsigned int first, unsigned int count);
+
+public:
+    /**
+     * Constructor, there are no free data blocks.
+     */
+    FreeExtents();
+
+    /**
+     * This method builds the free extents from the free data blocks of a DMap.
+     * @param dMap DMap
+     */
+    void load(DMap *dMap);
+
+    /**
+     * This method returns the number of free data blocks.
+     * @return free data blocks
+     */
+    unsigned int getFreeCount(void);
+
+    /**
+     * This method returns the number of free extents.
+     * @return free extents
+     */
+    unsigned int getExtentCount(void);
+
+    /**
+     * This method looks up the free extent holding a data block.
+     * @param block data block number
+     * @param first receives the first data block of the extent
+     * @param count receives the number of data blocks of the extent
+     * @return true for success, false if the data block is not free
+     */
+    bool find(unsigned int block, unsigned int *first, unsigned int *count);
+
+    /**
+     * This method assigns count free data blocks.
+     * @param count number of data blocks
+     * @param goal data block the assignment should start at or -1 without a goal
+     * @param blocks receives the assigned data block numbers, runs of consecutive blocks are ascending
+     * @return true for success, false if there are less than count free data blocks, then nothing is assigned
+     */
+    bool assign(unsigned int count, int goal, int *blocks);
+
+    /**
+     * This method releases count consecutive data blocks starting at first.
+     * @param first first data block
+     * @param count number of data blocks
+     */
+    void release(unsigned int first, unsigned int count);
+};
+
+#endif /* freeExtents_h */
@@ -0,0 +1,116 @@
+//
+//  journal.h
+//  myfs
+//
+
+#ifndef journal_h
+#define journal_h
+
+#include <cstdint>
+
+#include "blockbackend.h"
+
+// marks the descriptor block of a journal transaction
+#define JOURNAL_MAGIC 0x4d594a4c
+
+// size of the header starting the descriptor block of a transaction
+#define JOURNAL_HEADER_SIZE 24
+// position of the checksum in the header
+#define JOURNAL_CHECKSUM_OFFSET 16
+
+/**
+ * The Journal is a circular log of meta data blocks in a region of the block device. A transaction logs the
+ * images of changed home blocks, anywhere on the block device except the journal region, with one sequential
+ * write of its descriptor blocks and the block images, followed by a sync. Once a transaction is committed its
+ * blocks may be written to their home locations in any order.
+ * The header of the first descriptor block holds, in little-endian byte order (see diskformat.h):
+ * - JOURNAL_MAGIC (32 bit)
+ * - number of logged blocks following the descriptor blocks (32 bit)
+ * - sequence number of the transaction (64 bit)
+ * - checksum over the descriptor blocks and the logged blocks, computed with a zero checksum field (64 bit)
+ * The home block numbers of the logged blocks follow the header as little-endian 64 bit numbers, in the order of
+ * the logged blocks. A transaction of many blocks continues them in further descriptor blocks.
+ * Transactions are written one after another from the start of the region. A torn transaction fails its
+ * checksum, a transaction of an earlier pass through the region has a lower sequence number, so replay() stops
+ * at the first transaction which is not the expected one. reset() starts the region over after all committed
+ * blocks have been written home (checkpoint).
+ */
+class Journal {
+private:
+    BlockBackend *blockDevice;
+    unsigned int blockSize;
+    uint64_t journalStart;
+    unsigned int journalBlocks;
+    unsigned int maxBlocks;
+    unsigned int position;
+    uint64_t sequence;
+    uint64_t commits;
+
+    uint64_t checksum(char *transaction, unsigned int blocks);
+
+public:
+    /**
+     * Constructor, the journal is empty and its next transaction has sequence number 1.
+     * @param blockDevice block backend, its block size must be blockSize
+     * @param blockSize block size
+     * @param journalStart first block of the journal region
+     * @param journalBlocks number of blocks of the journal region, room for a transaction of maxBlocks blocks
+     * @param maxBlocks maximum number of blocks logged by one transaction
+     */
+    Journal(BlockBackend *blockDevice, unsigned int blockSize, uint64_t journalStart, unsigned int journalBlocks,
+            unsigned int maxBlocks);
+
+    /**
+     * This method returns the number of descriptor blocks of a transaction.
+     * @param blockSize block size
+     * @param count number of logged blocks
+     * @return descriptor blocks
+     */
+    static unsigned int getDescriptorBlocks(unsigned int blockSize, unsigned int count);
+
+    /**
+     * This method empties the journal, the next transaction is written to the start of the region.
+     * @param sequence sequence number of the next transaction
+     */
+    void reset(uint64_t sequence);
+
+    /**
+     * This method returns the sequence number of the next transaction.
+     * @return sequence
+     */
+    uint64_t getSequence(void);
+
+    /**
+     * This method returns the number of transactions committed since the constructor.
+     * @return commits
+     */
+    uint64_t getCommits(void);
+
+    /**
+     * This method tells if the journal may not have room for a transaction of maxBlocks blocks. It has to be
+     * reset before the next commit then.
+     * @return true if the journal has to be reset
+     */
+    bool isFull(void);
+
+    /**
+     * This method commits a transaction with one sequential write and syncs the block device.
+     * @param blocks home block numbers, each at most once
+     * @param buffers one buffer of blockSize bytes for every block
+     * @param count number of blocks, at least 1 and at most maxBlocks
+     * @return 0 for success or a negative error value, -ENOSPC if the journal has no room left
+     */
+    int commit(const uint64_t *blocks, char **buffers, unsigned int count);
+
+    /**
+     * This method writes the blocks of all complete transactions in the region, starting at its first block with
+     * the given sequence number, to their home locations. The block device is not synced. Afterwards
+     * getSequence() returns the sequence number following the last replayed transaction, the journal has to be
+     * reset before the next commit.
+     * @param sequence sequence number of the first transaction
+     * @return number of replayed transactions or a negative error value
+     */
+    int replay(uint64_t sequence);
+};
+
+#endif /* journal_h */
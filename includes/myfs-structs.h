@@ -10,58 +10,144 @@
 #define myFs_structs_h
 
 #include "blockdevice.h"
+#include "directory.h"
+#include "diskformat.h"
 #include "myfs-structs.h"
 #include <time.h>
+#include <string>
+#include <vector>
 
 /**
  * File system constants
+ * The block size is chosen when the file system is created and stored in the SuperBlock, BLOCK_SIZE is the
+ * default. The position of the DMap, Fat, journal and data blocks follows from the block size, see SuperBlock.
  */
 #define BLOCK_SIZE 512
+#define BLOCK_SIZE_MAX 65536
 
 #define SUPER_BLOCK_BLOCK_INDEX_START 0
 #define SUPER_BLOCK_BLOCKS 1
 #define FILE_SYSTEM_MAX_DATA_SIZE_IN_MiB 33554432
 #define FILE_SYSTEM_MAX_DATA_SIZE_IN_MB 30099999
 #define D_Map_SIZE 65536
-#define D_MAP_BLOCK_INDEX_START SUPER_BLOCK_BLOCK_INDEX_START+SUPER_BLOCK_BLOCKS
-#define D_MAP_BLOCKS D_Map_SIZE/BLOCK_SIZE
+// the DMap stores one bit per data block
+#define D_MAP_BYTES (D_Map_SIZE / 8)
 
 #define FAT_SIZE D_Map_SIZE*4
-#define FAT_BLOCK_INDEX_START D_MAP_BLOCK_INDEX_START+D_MAP_BLOCKS
-#define FAT_BLOCKS FAT_SIZE/BLOCK_SIZE
 
-#define NUM_DIR_ENTRIES 64
 #define NUM_OPEN_FILES 64
+// bytes of an inode in the inode table of a new file system, it is stored in the SuperBlock and an inode table block
+// holds blockSize / inodeSize inodes. The name of a file is kept in the entry of its directory only, see DirectoryBlock.
+#define INODE_SIZE 256
+// root index of the inode table, the inode table is stored in data blocks like a file
+#define INODE_TABLE 0
+// maximum number of data blocks the inode table grows by at once, it doubles up to that
+#define INODE_TABLE_GROWTH 64
 #define FILE_NAME_MAX_LENGTH 255
-#define ROOT_BLOCK_INDEX_START FAT_BLOCK_INDEX_START+FAT_BLOCKS
-#define ROOT_BLOCKS NUM_DIR_ENTRIES
+// number of extents stored with a file, a file with more extents is described by its fat chain only
+#define FILE_EXTENTS 16
+// bytes of the content of a small file stored in its inode in place of its extents, such a file has no data blocks
+#define INLINE_DATA_SIZE (FILE_EXTENTS * 12)
+// inode flag of a file whose content is stored in its inode
+#define INODE_INLINE_DATA 0x1
 
-#define DATA_BLOCKS_INDEX_START ROOT_BLOCK_INDEX_START+ROOT_BLOCKS
 #define DATA_BLOCKS FILE_SYSTEM_MAX_DATA_SIZE_IN_MiB/BLOCK_SIZE
 
+// 1 to memory map the container file on mount, data is then copied straight from and into the mapping
+#define MAP_CONTAINER 1
+// memory budget of the block cache in bytes, data and meta data blocks are cached
+#define BLOCK_CACHE_SIZE (8 * 1024 * 1024)
+// readahead window of a sequentially read file in bytes, it starts at READ_AHEAD_MIN_SIZE and doubles with every
+// sequential read up to READ_AHEAD_MAX_SIZE. The blocks are prefetched into the block cache, or into the host page
+// cache if the container is mapped
+#define READ_AHEAD_MIN_SIZE (16 * 1024)
+#define READ_AHEAD_MAX_SIZE (1024 * 1024)
+// memory for content appended to open files whose data blocks have not been allocated yet, in bytes. A write which
+// exceeds it allocates and writes the buffered content of its file.
+#define DELAYED_WRITE_BUDGET (8 * 1024 * 1024)
+// a read writes the access time of a file only if it is not newer than the last change or older than this many
+// seconds (relatime)
+#define ATIME_UPDATE_INTERVAL (24 * 60 * 60)
+// changed meta data blocks are committed to the journal by the first changing operation after this many seconds
+#define META_DATA_WRITE_BACK_INTERVAL 5
+// size of the journal region in bytes, it holds at least two transactions of all meta data blocks
+#define JOURNAL_SIZE (1024 * 1024)
+// number of changed inodes or directory blocks which are committed to the journal right away, whether
+// META_DATA_WRITE_BACK_INTERVAL has passed or not. This bounds the size of a transaction.
+#define JOURNAL_TRANSACTION_INODES 64
+// 1 to open the container file with O_DIRECT on mount, the host page cache is bypassed and the container is
+// not mapped
+#define DIRECT_IO_CONTAINER 0
+// 1 to load the container file into memory on mount and keep all blocks there, changes are lost on unmount
+#define RAM_CONTAINER 0
+
 /**
  * The SuperBlock contains:
+ * - format version, see diskformat.h
  * - file system size
  * - number of first SuperBlock block
  * - number of first DMap block
  * - number of first Fat block
- * - number of first Root block
+ * - number of first journal block
  * - number of files in the file system
+ * - block size
+ * - number of first data block
+ * - sequence number of the first transaction in the journal
+ * - data block holding the first inodes, the inode table continues in the data blocks of its own inode
+ * - number of inodes in the inode table, used or free
+ * - first free inode, the free inodes are linked by their parent index
+ * - size of all files and directories in bytes
+ * - bytes of an inode in the inode table
+ * It is stored behind FORMAT_MAGIC in the fields' order, see encode.
  */
 struct SuperBlock {
 private:
-    long unsigned int fileSystemSize = FILE_SYSTEM_MAX_DATA_SIZE_IN_MB;
-    unsigned int superBlockBlockIndexStart = SUPER_BLOCK_BLOCK_INDEX_START;
-    unsigned int dMapBlockIndexStart = D_MAP_BLOCK_INDEX_START;
-    unsigned int fatBlockIndexStart = FAT_BLOCK_INDEX_START;
-    unsigned int rootBlockIndexStart = ROOT_BLOCK_INDEX_START;
+    unsigned int formatVersion;
+    long unsigned int fileSystemSize;
+    unsigned int superBlockBlockIndexStart;
+    unsigned int dMapBlockIndexStart;
+    unsigned int fatBlockIndexStart;
+    unsigned int journalBlockIndexStart;
     unsigned int fileCount = 0;
+    unsigned int blockSize;
+    unsigned int dataBlockIndexStart;
+    uint64_t journalSequence;
+    int inodeTableBlock;
+    unsigned int inodeCount;
+    int freeInode;
+    long unsigned int usedSize;
+    unsigned int inodeSize;
 
 public:
-    SuperBlock();
+    /**
+     * Constructor, computes the layout of a file system with the given block size. The file system size
+     * grows with the block size, the number of data blocks stays DATA_BLOCKS.
+     * @param blockSize power of two between BLOCK_SIZE and BLOCK_SIZE_MAX
+     */
+    SuperBlock(unsigned int blockSize = BLOCK_SIZE);
 
     ~SuperBlock();
 
+    /**
+     * This method encodes the SuperBlock in the on-disk format of FORMAT_VERSION.
+     * @param frame buffer of at least BLOCK_SIZE bytes
+     */
+    void encode(char *frame);
+
+    /**
+     * This method decodes a SuperBlock stored in the on-disk format. Fields missing in an older format version
+     * get their defaults.
+     * @param frame buffer of at least BLOCK_SIZE bytes
+     * @return 0 for success, -EINVAL if the frame holds no SuperBlock or one of a newer format version
+     */
+    int decode(const char *frame);
+
+    /**
+     * This methods returns the format version the SuperBlock has been stored with.
+     * @return formatVersion
+     */
+    unsigned int getFormatVersion(void);
+
     /**
      * This methods increases the number of files by 1.
      */
@@ -96,22 +182,134 @@ public:
      */
     unsigned int getFatBlockIndexStart(void);
 
-    /**
-     * This methods returns the first block of the root array.
-     * @return firstRootBlock
-     */
-    unsigned int getRootBlockIndexStart(void);
-
     /**
      * This methods returns the number of files in the file system.
      * @return fileCount
      */
     unsigned int getFileCount(void);
+
+    /**
+     * This methods returns the block size of the file system.
+     * @return blockSize
+     */
+    unsigned int getBlockSize(void);
+
+    /**
+     * This methods returns the number of DMap blocks.
+     * @return dMapBlocks
+     */
+    unsigned int getDMapBlocks(void);
+
+    /**
+     * This methods returns the number of fat blocks.
+     * @return fatBlocks
+     */
+    unsigned int getFatBlocks(void);
+
+    /**
+     * This methods returns the first data block.
+     * @return firstDataBlock
+     */
+    unsigned int getDataBlockIndexStart(void);
+
+    /**
+     * This methods returns the first block of the journal, the SuperBlock, DMap and Fat blocks lie in front of it.
+     * @return firstJournalBlock
+     */
+    unsigned int getJournalBlockIndexStart(void);
+
+    /**
+     * This methods returns the number of journal blocks.
+     * @return journalBlocks
+     */
+    unsigned int getJournalBlocks(void);
+
+    /**
+     * This methods returns the maximum number of blocks of a journal transaction: the SuperBlock, all DMap and Fat
+     * blocks, the inode table blocks of twice JOURNAL_TRANSACTION_INODES inodes and as many directory blocks.
+     * @return transactionBlocks
+     */
+    unsigned int getJournalTransactionBlocks(void);
+
+    /**
+     * This methods returns the sequence number of the transaction at the start of the journal.
+     * @return journalSequence
+     */
+    uint64_t getJournalSequence(void);
+
+    /**
+     * This methods sets the sequence number of the transaction at the start of the journal.
+     * @param newJournalSequence
+     */
+    void setJournalSequence(uint64_t newJournalSequence);
+
+    /**
+     * This methods returns the data block holding the first inodes, the inode of the inode table among them.
+     * @return inodeTableBlock
+     */
+    int getInodeTableBlock(void);
+
+    /**
+     * This methods sets the data block holding the first inodes.
+     * @param newInodeTableBlock
+     */
+    void setInodeTableBlock(int newInodeTableBlock);
+
+    /**
+     * This methods returns the number of inodes in the inode table, used or free.
+     * @return inodeCount
+     */
+    unsigned int getInodeCount(void);
+
+    /**
+     * This methods sets the number of inodes in the inode table.
+     * @param newInodeCount
+     */
+    void setInodeCount(unsigned int newInodeCount);
+
+    /**
+     * This methods returns the first free inode.
+     * @return root index of the free inode or -1 if all inodes are used
+     */
+    int getFreeInode(void);
+
+    /**
+     * This methods sets the first free inode.
+     * @param newFreeInode root index of the free inode or -1
+     */
+    void setFreeInode(int newFreeInode);
+
+    /**
+     * This methods returns the size of all files and directories.
+     * @return usedSize
+     */
+    unsigned long getUsedSize(void);
+
+    /**
+     * This methods sets the size of all files and directories.
+     * @param newUsedSize
+     */
+    void setUsedSize(unsigned long newUsedSize);
+
+    /**
+     * This methods returns the bytes of an inode in the inode table.
+     * @return inodeSize
+     */
+    unsigned int getInodeSize(void);
+};
+
+/**
+ * An Extent maps length consecutive blocks of a file, starting at block fileBlock of the file, to consecutive
+ * data blocks starting at dataBlock.
+ */
+struct Extent {
+    unsigned int fileBlock;
+    int dataBlock;
+    unsigned int length;
 };
 
 /**
  * A MyFile contains:
- * - file name
  * - file size
  * - user id
  * - group id
@@ -125,10 +323,11 @@ public:
  * - number of first Fat block
  * - number of first Root block
  * - number of files in the file system
+ * - root index of the parent directory, the next free inode for a free inode
+ * - flags, see INODE_INLINE_DATA
  */
 struct MyFile {
 private:
-    char fileName[FILE_NAME_MAX_LENGTH + 1];
     unsigned int fileSize;
     unsigned int userID;
     unsigned int groupID;
@@ -138,6 +337,13 @@ private:
     time_t cTime;
     int firstDataBlock;
     short int openIndex;
+    unsigned int extentCount;
+    union {
+        Extent extents[FILE_EXTENTS];
+        char inlineData[INLINE_DATA_SIZE];
+    };
+    int parentIndex;
+    unsigned int flags = 0;
 public:
     /**
      * Constructor
@@ -150,10 +356,18 @@ public:
     ~MyFile();
 
     /**
-     * This methods sets the file name of a new file.
-     * @param newFileName
+     * This method encodes the inode of a file in the on-disk format of FORMAT_VERSION. The open index is not stored.
+     * @param record buffer of the inode size
      */
-    void setFileName(char *newFileName);
+    void encode(char *record);
+
+    /**
+     * This method decodes an inode stored in the on-disk format, the open index is cleared. Fields missing in an
+     * older format version get their defaults.
+     * @param record buffer of the inode size
+     * @param formatVersion format version of the file system
+     */
+    void decode(const char *record, unsigned int formatVersion);
 
     /**
     * This methods sets the size of a file.
@@ -215,10 +429,10 @@ public:
     void clearOpenIndex();
 
     /**
-     * This methods returns the name of a file.
-     * @return fileName
+     * This method sets the directory of a file.
+     * @param newParentIndex root index of the directory or ROOT_DIRECTORY
      */
-    char *getFileName(void);
+    void setParentIndex(int newParentIndex);
 
     /**
      * This methods returns the size of a file.
@@ -273,6 +487,138 @@ public:
      * @return openIndex
      */
     short int getOpenIndex(void);
+
+    /**
+     * This methods returns the directory of a file.
+     * @return root index of the directory or ROOT_DIRECTORY
+     */
+    int getParentIndex(void);
+
+    /**
+     * This method removes all extents of a file, it has no data blocks afterwards.
+     */
+    void clearExtents(void);
+
+    /**
+     * This method tells if the content of a file is stored in its inode.
+     * @return true for inline data
+     */
+    bool hasInlineData(void);
+
+    /**
+     * This methods returns the content of a file stored in its inode, it is not copied.
+     * @return inlineData
+     */
+    const char *getInlineData(void);
+
+    /**
+     * This method stores the content of a file in its inode in place of its extents. The file must not have data
+     * blocks.
+     * @param data content of the file
+     * @param size size of the content, at most INLINE_DATA_SIZE
+     */
+    void setInlineData(const char *data, unsigned int size);
+
+    /**
+     * This method drops the content stored in the inode of a file, it has no data blocks and no extents
+     * afterwards.
+     */
+    void clearInlineData(void);
+
+    /**
+     * This method tells if the data blocks of a file are described by its extents. Otherwise the file has more
+     * than FILE_EXTENTS extents and only its fat chain describes them.
+     * @return true if the extents are valid
+     */
+    bool hasExtents(void);
+
+    /**
+     * This methods returns the number of extents of a file.
+     * @return extentCount
+     */
+    unsigned int getExtentCount(void);
+
+    /**
+     * This methods returns the number of data blocks described by the extents of a file.
+     * @return data blocks
+     */
+    unsigned int getExtentBlocks(void);
+
+    /**
+     * This method appends count consecutive data blocks to the end of a file. They extend the last extent if
+     * they follow it. If all extents are used, the extents become invalid.
+     * @param dataBlock first data block
+     * @param count number of data blocks
+     */
+    void appendExtent(int dataBlock, unsigned int count);
+
+    /**
+     * This method shortens the extents of a file to its first blocks data blocks.
+     * @param blocks number of data blocks kept
+     */
+    void truncateExtents(unsigned int blocks);
+
+    /**
+     * This method looks up data blocks of a file with a binary search over its extents.
+     * @param fileBlock first block of the file
+     * @param count number of blocks
+     * @param blocks receives the data block numbers
+     * @return number of data blocks found, less than count if the file ends before
+     */
+    unsigned int findDataBlocks(unsigned int fileBlock, unsigned int count, int *blocks);
+};
+
+// bytes of the encoded SuperBlock and of an encoded inode in FORMAT_VERSION
+#define SUPER_BLOCK_RECORD_SIZE 76
+#define INODE_RECORD_SIZE (60 + INLINE_DATA_SIZE)
+static_assert(sizeof(Extent) * FILE_EXTENTS == INLINE_DATA_SIZE, "the inline data takes the place of the extents");
+static_assert(SUPER_BLOCK_RECORD_SIZE <= BLOCK_SIZE, "the SuperBlock has to fit into its block");
+static_assert(INODE_RECORD_SIZE <= INODE_SIZE, "an encoded MyFile has to fit into one inode of the inode table");
+
+/**
+ * A ReadAhead contains the readahead state of an open file:
+ * - offset where the next sequential read starts
+ * - readahead window in blocks, 0 after a random access
+ * - first block number of the file which has not been prefetched
+ */
+struct ReadAhead {
+    off_t nextOffset;
+    unsigned int window;
+    unsigned int prefetchedUntil;
+};
+
+/**
+ * A DelayedWrite contains the content appended to an open file which has no data blocks yet:
+ * - file offset of the content, the first byte of a block behind the data blocks of the file
+ * - buffered content, NULL if nothing is buffered
+ * - length of the content
+ * - capacity of the buffer, a multiple of the block size
+ */
+struct DelayedWrite {
+    off_t start;
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+/**
+ * A BlockIndex contains the data blocks of an open file or the inode table whose extents are not valid, so offsets
+ * are translated without walking the fat chain:
+ * - data block number of every block of the file
+ */
+struct BlockIndex {
+    std::vector<int> blocks;
+};
+
+/**
+ * A Dentry contains a directory found by a lookup, it is kept by the dentry cache under its parent and the hash of
+ * its name:
+ * - name of the directory, it tells apart names with the same hash
+ * - root index of the directory
+ */
+struct Dentry {
+    std::string name;
+    int dirIndex;
 };
 
 #endif /* myFs_structs_h */
\ No newline at end of file
@@ -11,28 +11,69 @@
 
 #include <fuse.h>
 #include <cmath>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
+#include "blockcache.h"
 #include "blockdevice.h"
+#include "dmap.h"
+#include "freeextents.h"
+#include "journal.h"
+#include "ramblockdevice.h"
 #include "myfs-structs.h"
 
 class MyFS {
 private:
     static MyFS *_instance;
     FILE *logFile;
-    BlockDevice *blockDevice;
+    BlockBackend *blockDevice;
+    BlockCache *blockCache;
+    //NULL for file systems created without a journal
+    Journal *journal = NULL;
     SuperBlock *superBlock;
-    char dMap[DATA_BLOCKS];
+    unsigned int blockSize;
+    unsigned int dataBlocksIndexStart;
+    unsigned int inodesPerBlock;
+    DMap dMap;
+    FreeExtents freeExtents;
+    //fat entries, a fat block is read on first use, see getFat
     int fat[DATA_BLOCKS];
-    MyFile *root[NUM_DIR_ENTRIES];
-    int lastBlockRead = -1;
-    int lastBlockWritten = -1;
-    char lastBlockReadFrame[BLOCK_SIZE * NUM_OPEN_FILES];
-    char lastBlockWritenFrame[BLOCK_SIZE * NUM_OPEN_FILES];
+    std::vector<bool> loadedFatBlocks;
+    //inodes by their root index, NULL until their inode table block has been read
+    std::vector<MyFile *> root;
+    //directories by their parent and the hash of their name (dentry cache), see getDentryKey
+    std::unordered_map<uint64_t, Dentry> dentryCache;
+    //buffer for the directory block of a lookup
+    char *directoryFrame = NULL;
+    //readahead state, buffered content and block index by root index, only files which need one have an entry
+    std::unordered_map<int, ReadAhead> readAhead;
+    std::unordered_map<int, DelayedWrite> delayedWrites;
+    std::unordered_map<int, BlockIndex> blockIndex;
+    size_t delayedWriteBytes = 0;
+    bool punchHoles = true;
+    //one data block of every run released since the last write back, its free extent is punched then
+    std::vector<int> pendingDiscards;
+    //DMap and fat blocks changed since the last write back, in this order
+    std::vector<bool> dirtyMetaBlocks;
+    //root indices of the inodes changed since the last write back
+    std::unordered_set<int> dirtyInodes;
+    //images of the directory blocks changed since the last write back by their data block, they are committed
+    //with the inodes
+    std::unordered_map<int, char *> dirtyDirectoryBlocks;
+    //true while blocks of a resized directory may not have reached the block device, the next commit flushes them
+    bool unflushedDirectoryBlocks = false;
+    //released directory blocks, they may have images in the journal and are reused after the next checkpoint
+    std::vector<int> heldDataBlocks;
+    bool superBlockDirty = false;
+    bool metaDataDirty = false;
+    time_t metaDataWrittenBack = 0;
+    //meta data blocks written by writeMetaData since the mount
+    uint64_t metaDataBlocksWritten = 0;
     unsigned short int openFiles = 0;
-    short int openFilesArray[BLOCK_SIZE * NUM_OPEN_FILES];
 
     long unsigned int currentFileSystemSize = 0;
-    int hasRootIndexAFile[NUM_DIR_ENTRIES];
 
 
 
@@ -122,10 +163,130 @@ public:
 
     // TODO: Add methods of your file system here
     /**
-     * This method removes '/' at the beginning of a file.
-     * @param log=1 for logging
+     * This method opens the container and loads the meta data needed by the operations, fuseInit() calls it with
+     * the files given to mount.myfs.
+     * @param containerFile path of the container file
+     * @param logFileName path of the logfile, it is created or truncated
+     * @return 0 for success or a negative error value, then no operation can run
      */
-    static char *clearPath(const char *path);
+    int mountContainer(const char *containerFile, const char *logFileName);
+
+    /**
+     * This method looks up the file or directory at a path, its inode is loaded.
+     * @param path path of the file starting with '/'
+     * @return root index of the file or a negative error value, -ENOENT if there is no such file
+     */
+    int findFile(const char *path);
+
+    /**
+     * This method splits a path into its directory and the name of its last component.
+     * @param path path starting with '/'
+     * @param dirIndex receives the root index of the directory or ROOT_DIRECTORY
+     * @param name receives the name of the last component, it points into path
+     * @return 0 for success or a negative error value
+     */
+    int resolvePath(const char *path, int *dirIndex, const char **name);
+
+    /**
+     * This method looks up a directory component by component. Every component is looked up in the dentry cache
+     * without allocating, on a miss it is found by reading one directory block.
+     * @param path path starting with '/'
+     * @param length length of the directory path in path, 0 for the root directory
+     * @param dirIndex receives the root index of the directory or ROOT_DIRECTORY
+     * @return 0 for success or a negative error value, -ENOTDIR if a component is a file
+     */
+    int findDirectory(const char *path, size_t length, int *dirIndex);
+
+    /**
+     * This method returns the key of a directory in the dentry cache.
+     * @param parentIndex root index of the parent directory
+     * @param name name of the directory, not necessarily zero terminated
+     * @param length length of the name
+     * @return key
+     */
+    uint64_t getDentryKey(int parentIndex, const char *name, size_t length);
+
+    /**
+     * This method looks up a name in a directory by reading one directory block, the inode of the file is loaded.
+     * @param dirIndex root index of the directory
+     * @param name file name, not necessarily zero terminated
+     * @param length length of the name
+     * @param rootIndex receives the root index of the file
+     * @return 0 for success or a negative error value, -ENOENT if there is no such entry
+     */
+    int findEntry(int dirIndex, const char *name, size_t length, int *rootIndex);
+
+    /**
+     * This method adds a file to a directory under a file name. A full directory block doubles the number of
+     * directory blocks.
+     * @param dirIndex root index of the directory
+     * @param name file name
+     * @param rootIndex root index of the file
+     * @return 0 for success or a negative error value
+     */
+    int addEntry(int dirIndex, const char *name, int rootIndex);
+
+    /**
+     * This method removes a file from a directory.
+     * @param dirIndex root index of the directory
+     * @param name file name
+     * @return 0 for success or a negative error value
+     */
+    int removeEntry(int dirIndex, const char *name);
+
+    /**
+     * This method grows a directory to buckets directory blocks and distributes its entries anew. The entries are
+     * written to new data blocks, the old ones are held until the next checkpoint, so a crash leaves either
+     * directory intact.
+     * @param dirIndex root index of the directory
+     * @param buckets new number of directory blocks, a power of two
+     * @return 0 for success or a negative error value
+     */
+    int resizeDirectory(int dirIndex, unsigned int buckets);
+
+    /**
+     * This method reads directory blocks. Blocks changed since the last write back are taken from their images.
+     * @param dirIndex root index of the directory
+     * @param firstBucket first directory block
+     * @param count number of directory blocks
+     * @param blocks receives the data block numbers
+     * @param buffers one buffer of blockSize bytes for every directory block
+     * @return 0 for success or a negative error value, -EIO if the directory has less blocks
+     */
+    int readDirectoryBlocks(int dirIndex, unsigned int firstBucket, unsigned int count, int *blocks,
+                            char **buffers);
+
+    /**
+     * This method keeps the image of a changed directory block until the next write back, which commits it with
+     * the inodes in one transaction.
+     * @param block data block number
+     * @param buffer block content of blockSize bytes
+     */
+    void writeDirectoryBlock(int block, const char *buffer);
+
+    /**
+     * This method counts the entries of a directory.
+     * @param dirIndex root index of the directory
+     * @param count receives the number of entries
+     * @return 0 for success or a negative error value
+     */
+    int getEntryCount(int dirIndex, unsigned int *count);
+
+    /**
+     * This method creates an empty file or directory.
+     * @param path path of the new file
+     * @param mode mode of the new file
+     * @return 0 for success or a negative error value
+     */
+    int createFile(const char *path, mode_t mode);
+
+    /**
+     * This method removes a file or an empty directory from its directory and releases its data blocks.
+     * @param fileIndex root index of the file
+     * @param name file name in its directory
+     * @return 0 for success or a negative error value
+     */
+    int removeFile(int fileIndex, const char *name);
 
     /**
      * This method logs informations about the superblock.
@@ -140,29 +301,270 @@ public:
     void logDMapAndFatInfos(int log);
 
     /**
-     * This method logs informations about the all files in the root array.
+     * This method logs informations about the all loaded inodes.
      * @param log=1 for logging
      */
     void logRootInfos(int log);
 
     /**
-     * This method checks if a file is already in use.
-     * @param newFileName file name which should be checked
-     * @return 0 if this file is not used or -1 if it is used
+     * This method loads an inode unless it is loaded. All inodes of its inode table block are loaded with it.
+     * @param rootIndex root index of the inode
+     * @return 0 for success or a negative error value, -EIO if the inode table has no such inode
+     */
+    int loadFile(int rootIndex);
+
+    /**
+     * This method returns the data block of a block of the inode table.
+     * @param tableBlock block number in the inode table
+     * @param block receives the data block number
+     * @return 0 for success or -EIO if the inode table has no such block
+     */
+    int getInodeTableBlock(unsigned int tableBlock, int *block);
+
+    /**
+     * This method takes an inode for a new file. The first free inode is reused, otherwise the inode table is
+     * extended, growing it by data blocks when it is full.
+     * @param rootIndex receives the root index of the inode, the caller stores the new file there
+     * @return 0 for success or a negative error value
+     */
+    int allocateRootIndex(int *rootIndex);
+
+    /**
+     * This method marks an inode free and puts it in front of the free inodes.
+     * @param rootIndex root index of the inode
+     */
+    void releaseRootIndex(int rootIndex);
+
+    /**
+     * This method appends empty data blocks to the inode table.
+     * @return 0 for success or a negative error value
+     */
+    int growInodeTable();
+
+    /**
+     * This method assigns count free data blocks. They start at the goal if it is free, otherwise a contiguous
+     * run close behind the goal or the best fitting run is preferred.
+     * @param blocks receives the assigned data block numbers
+     * @param count number of data blocks
+     * @param goal data block the assigned blocks should start at or -1 without a goal
+     * @return 0 for success or -ENOSPC, then no data block has been assigned
+     */
+    int assignFreeDataBlocks(int *blocks, unsigned int count, int goal = -1);
+
+    /**
+     * This method returns the goal for data blocks appended to a file, the data block behind its last one.
+     * @param rootIndex root index of the file
+     * @return goal or -1 if the file has no data blocks
+     */
+    int getAppendGoal(int rootIndex);
+
+    /**
+     * This method marks data blocks as free, their space in the container file is released with the next write
+     * back.
+     * @param blocks data block numbers, they are sorted
+     * @param count number of data blocks
+     */
+    void releaseDataBlocks(int *blocks, unsigned int count);
+
+    /**
+     * This method marks directory blocks as free and drops their images. They are reused after the next
+     * checkpoint, so replaying a journaled image cannot overwrite a reused block.
+     * @param blocks data block numbers
+     * @param count number of data blocks
+     */
+    void releaseDirectoryBlocks(const int *blocks, unsigned int count);
+
+    /**
+     * This method makes free data blocks assignable again and drops their cached copies. Their space in the
+     * container file is released with the next write back.
+     * @param blocks data block numbers, they are sorted
+     * @param count number of data blocks
+     */
+    void reuseDataBlocks(int *blocks, unsigned int count);
+
+    /**
+     * This method releases the space of the data blocks released since the last write back in the container file.
+     * The free extent holding them is punched once in whole BD_DISCARD_ALIGNMENT units, so runs released by
+     * different operations are coalesced. Blocks assigned again in the meantime keep their content.
+     */
+    void discardFreeDataBlocks();
+
+    /**
+     * This method returns the number of data blocks of a file.
+     * @param rootIndex root index of the file
+     * @return data blocks
+     */
+    unsigned int getDataBlockCount(int rootIndex);
+
+    /**
+     * This method looks up data blocks of a file. The block index of an open file is used, otherwise its extents
+     * are searched and a file without valid extents walks its fat chain.
+     * @param rootIndex root index of the file
+     * @param firstBlockNumber first block of the file
+     * @param count number of blocks
+     * @param blocks receives the data block numbers
+     * @return number of data blocks found, less than count if the file ends before
+     */
+    unsigned int getDataBlocks(int rootIndex, unsigned int firstBlockNumber, unsigned int count, int *blocks);
+
+    /**
+     * This method appends assigned data blocks to the end of a file, its fat chain, its extents and its block
+     * index.
+     * @param rootIndex root index of the file
+     * @param blocks data block numbers
+     * @param count number of data blocks
+     */
+    void appendDataBlocks(int rootIndex, const int *blocks, unsigned int count);
+
+    /**
+     * This method rebuilds the extents of a file from its fat chain, they stay invalid if there are too many.
+     * @param file file
+     */
+    void buildExtents(MyFile *file);
+
+    /**
+     * This method builds the block index of a file from its fat chain while the file is open or is the inode
+     * table and its extents are not valid, otherwise the block index is dropped.
+     * @param rootIndex root index of the file
+     */
+    void updateBlockIndex(int rootIndex);
+
+    /**
+     * This method buffers content appended to an open file behind its data blocks (delayed allocation).
+     * @param rootIndex root index of the file
+     * @param buf content
+     * @param offset file offset of the content
+     * @param size content size
+     * @return 0 for success or a negative error value
+     */
+    int bufferDelayedWrite(int rootIndex, const char *buf, off_t offset, size_t size);
+
+    /**
+     * This method assigns data blocks for the buffered content of a file, appends them to its fat chain and
+     * writes the content with one submission.
+     * @param rootIndex root index of the file
+     * @return 0 for success or a negative error value, then the content stays buffered
+     */
+    int commitDelayedWrite(int rootIndex);
+
+    /**
+     * This method drops the buffered content of a file without writing it.
+     * @param rootIndex root index of the file
+     */
+    void discardDelayedWrite(int rootIndex);
+
+    /**
+     * This method copies the content between buf and the data blocks of a memory mapped container without
+     * staging any block.
+     * @param blocks data block indices, the first block contains offset
+     * @param count number of data blocks
+     * @param offset file offset of the content
+     * @param buf buffer
+     * @param size content size
+     * @param write true for copying buf into the blocks, false for copying the blocks into buf
+     * @return true if the content has been copied, false if a block is not mapped and nothing has been copied
+     */
+    bool copyMappedDataBlocks(const int *blocks, unsigned int count, off_t offset, char *buf, size_t size,
+                              bool write);
+
+    /**
+     * This method reads or writes data blocks through the block cache. Missing blocks are read with one batch,
+     * physically contiguous blocks are merged into one vectored request.
+     * @param blocks data block indices
+     * @param buffers one buffer of blockSize bytes for every data block
+     * @param count number of data blocks
+     * @param write true for writing, false for reading
+     * @return 0 for success or a negative error value
+     */
+    int transferDataBlocks(const int *blocks, char **buffers, unsigned int count, bool write);
+
+    /**
+     * This method detects sequential reads of an open file and prefetches its next data blocks in the background,
+     * into the block cache or for a mapped container into the host page cache. The window doubles with every
+     * sequential read and collapses on a random access.
+     * @param rootIndex root index of the file
+     * @param offset offset of the finished read
+     * @param size size of the finished read
+     */
+    void readAheadAfter(int rootIndex, off_t offset, size_t size);
+
+    /**
+     * This method reads a fat block into the fat entries unless it has been read before.
+     * @param fatBlock number of the fat block, counted from the first fat block
+     * @return 0 for success or a negative error value
+     */
+    int loadFatBlock(unsigned int fatBlock);
+
+    /**
+     * This method returns the fat entry of a data block, its fat block is read on first use.
+     * @param block data block number
+     * @return next data block of the file or -1 at the end of the file or if the fat block cannot be read
+     */
+    int getFat(int block);
+
+    /**
+     * This method changes the fat entry of a data block and marks its fat block dirty. The change is dropped if
+     * the fat block cannot be read.
+     * @param block data block number
+     * @param next next data block of the file or -1
+     */
+    void setFat(int block, int next);
+
+    /**
+     * This method marks the DMap block holding the bit of a data block dirty.
+     * @param block data block number
+     */
+    void markDMapDirty(int block);
+
+    /**
+     * This method sets the access time of a read file if it is not newer than its last change or older than
+     * ATIME_UPDATE_INTERVAL (relatime), so repeated reads do not dirty its inode.
+     * @param rootIndex root index of the file
+     */
+    void updateATime(int rootIndex);
+
+    /**
+     * This method marks the inode of a file dirty.
+     * @param rootIndex root index of the file
+     */
+    void markRootDirty(int rootIndex);
+
+    /**
+     * This method commits the superBlock, all dirty DMap and fat blocks, the inode table blocks of all dirty
+     * inodes and the dirty directory blocks as one journal transaction and writes them into the block cache, they
+     * reach their home blocks with later write backs. Without a journal the blocks are written through to the block
+     * device. Afterwards the space of the released data blocks is released in the container file.
+     * @return 0 for success or a negative error value
+     */
+    int writeMetaData();
+
+    /**
+     * This method returns the number of meta data blocks written by writeMetaData since the mount.
+     * @return written meta data blocks
+     */
+    uint64_t getMetaDataBlocksWritten();
+
+    /**
+     * This method commits dirty meta data to the journal if the last commit is more than
+     * META_DATA_WRITE_BACK_INTERVAL seconds ago or JOURNAL_TRANSACTION_INODES inodes or directory blocks are
+     * dirty.
      */
-    int checkFileIfNotUsed(char *newFileName);
+    void writeBackMetaDataIfDue();
 
     /**
-     * This method find a free space in the root array for an new file.
-     * @return index in the root array for the new file or -1 as error
+     * This method replays the transactions committed since the last checkpoint into the home blocks and starts
+     * the journal over. It is called on mount before the meta data is read.
+     * @return 0 for success or a negative error value
      */
-    int findFreeRootIndex();
+    int replayJournal();
 
     /**
-     * This methods assigns a freeDataBlock to a data block of a file.
-     * @return assigned data block number or -1 as error
+     * This method writes all committed meta data blocks home, syncs the block device and then stores the sequence
+     * number of the next transaction in the superBlock, so the journal starts over (checkpoint). The held data
+     * blocks are reused afterwards.
+     * @return 0 for success or a negative error value
      */
-    int assignFreeDataBlock();
+    int checkpointJournal();
 };
 
 #endif /* myFs_h */
\ No newline at end of file
@@ -0,0 +1,90 @@
+//
+//  ramblockdevice.h
+//  myfs
+//
+
+#ifndef ramBlockDevice_h
+#define ramBlockDevice_h
+
+#include <pthread.h>
+#include <vector>
+
+#include "blockbackend.h"
+
+// a RamBlockDevice allocates memory in chunks of this size, a multiple of every supported block size
+#define RD_CHUNK_SIZE (1024 * 1024)
+
+/**
+ * A RamBlockDevice keeps all blocks in memory, so MyFS can run without any I/O.
+ * open() loads a container file into memory, create() starts with no blocks. The container file is never written,
+ * all changes are lost on close(). Memory is allocated in chunks of RD_CHUNK_SIZE bytes when a chunk is written
+ * first, chunks which have never been written or have been discarded read as zeros and take no memory.
+ * After map() getBlockPointer() hands out pointers to the blocks, they stay valid until close().
+ * A RamBlockDevice is thread safe except for open, create, close and resize.
+ */
+class RamBlockDevice : public BlockBackend {
+private:
+    std::vector<char *> chunks;
+    uint64_t size;
+    bool mapped;
+    pthread_rwlock_t chunkLock;
+
+    char *getChunk(size_t chunk, bool allocate);
+    void freeChunks(void);
+
+public:
+    RamBlockDevice(u_int32_t blockSize = BD_BLOCK_SIZE);
+    ~RamBlockDevice() override;
+
+    /**
+     * This method loads a container file into memory.
+     * @param path container file
+     * @param flags ignored
+     * @return 0 for success or a negative error value
+     */
+    int open(const char *path, int flags = 0) override;
+
+    /**
+     * This method starts with no blocks, the container file is not touched.
+     * @param path ignored
+     * @param flags ignored
+     * @return 0
+     */
+    int create(const char *path, int flags = 0) override;
+
+    /**
+     * This method drops all blocks.
+     * @return 0
+     */
+    int close() override;
+
+    int readv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) override;
+    int writev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) override;
+
+    /**
+     * This method enables getBlockPointer(), the blocks are in memory already.
+     * @return 0
+     */
+    int map() override;
+    int unmap() override;
+
+    /**
+     * This method returns a pointer to a block, a chunk which has never been written is allocated.
+     * @param blockNo block number
+     * @return pointer to the block or NULL if map() has not been called or the block lies behind the end
+     */
+    char *getBlockPointer(uint64_t blockNo) override;
+
+    /**
+     * This method zeroes the blocks and frees chunks which are discarded completely.
+     */
+    int discard(uint64_t firstBlock, uint64_t count) override;
+
+    /**
+     * This method returns the end of the last written block in bytes.
+     * @return size
+     */
+    uint64_t getSize() override;
+};
+
+#endif /* ramBlockDevice_h */
@@ -0,0 +1,152 @@
+//
+//  blockbackend.cpp
+//  myfs
+//
+
+#include <cassert>
+#include <errno.h>
+#include <limits.h>
+
+#include "blockbackend.h"
+
+BlockBackend::BlockBackend(u_int32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    this->blockSize = blockSize;
+}
+
+BlockBackend::~BlockBackend() {}
+
+void BlockBackend::resize(u_int32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    this->blockSize = blockSize;
+}
+
+bool BlockBackend::isDirect() {
+    return false;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockBackend::read(uint64_t blockNo, char *buffer) {
+    return this->readBlocks(blockNo, 1, buffer);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockBackend::write(uint64_t blockNo, char *buffer) {
+    return this->writeBlocks(blockNo, 1, buffer);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockBackend::readBlocks(uint64_t firstBlock, uint64_t count, char *buffer) {
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t) count * this->blockSize;
+    return this->readv(firstBlock, &iov, 1);
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockBackend::writeBlocks(uint64_t firstBlock, uint64_t count, char *buffer) {
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t) count * this->blockSize;
+    return this->writev(firstBlock, &iov, 1);
+}
+
+int BlockBackend::submit(BlockBatch *batch) {
+
+    int ret = 0;
+
+    for (size_t r = 0; r < batch->requests.size(); r++) {
+        BlockBatch::Request &request = batch->requests[r];
+        int requestRet;
+        if (request.write)
+            requestRet = writev(request.firstBlock, &batch->iovs[request.firstIov], request.iovcnt);
+        else
+            requestRet = readv(request.firstBlock, &batch->iovs[request.firstIov], request.iovcnt);
+        if (requestRet < 0 && ret == 0)
+            ret = requestRet;
+    }
+
+    batch->clear();
+    return ret;
+}
+
+bool BlockBackend::hasRing() {
+    return false;
+}
+
+int BlockBackend::map() {
+    return -EINVAL;
+}
+
+int BlockBackend::unmap() {
+    return 0;
+}
+
+char *BlockBackend::getBlockPointer(uint64_t blockNo) {
+    return NULL;
+}
+
+int BlockBackend::willNeed(uint64_t firstBlock, uint64_t count) {
+    return 0;
+}
+
+int BlockBackend::discard(uint64_t firstBlock, uint64_t count) {
+    return -EOPNOTSUPP;
+}
+
+int BlockBackend::sync() {
+    return 0;
+}
+
+BlockBatch::BlockBatch(u_int32_t blockSize) {
+    assert(blockSize % 512 == 0);
+    this->blockSize = blockSize;
+}
+
+void BlockBatch::queue(bool write, uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
+    // a single request carries at most IOV_MAX buffers
+    while (iovcnt > 0) {
+        Request request;
+        request.write = write;
+        request.firstBlock = firstBlock;
+        request.firstIov = this->iovs.size();
+        request.iovcnt = iovcnt < IOV_MAX ? iovcnt : IOV_MAX;
+        for (int i = 0; i < request.iovcnt; i++)
+            firstBlock += iov[i].iov_len / this->blockSize;
+        this->iovs.insert(this->iovs.end(), iov, iov + request.iovcnt);
+        this->requests.push_back(request);
+        iov += request.iovcnt;
+        iovcnt -= request.iovcnt;
+    }
+}
+
+void BlockBatch::queueRead(uint64_t firstBlock, uint64_t count, char *buffer) {
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t) count * this->blockSize;
+    queue(false, firstBlock, &iov, 1);
+}
+
+void BlockBatch::queueWrite(uint64_t firstBlock, uint64_t count, char *buffer) {
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = (size_t) count * this->blockSize;
+    queue(true, firstBlock, &iov, 1);
+}
+
+void BlockBatch::queueReadv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
+    queue(false, firstBlock, iov, iovcnt);
+}
+
+void BlockBatch::queueWritev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
+    queue(true, firstBlock, iov, iovcnt);
+}
+
+unsigned int BlockBatch::size() {
+    return this->requests.size();
+}
+
+void BlockBatch::clear() {
+    this->requests.clear();
+    this->iovs.clear();
+}
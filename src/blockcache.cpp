@@ -0,0 +1,362 @@
+//
+//  blockcache.cpp
+//  myfs
+//
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "blockcache.h"
+
+BlockCache::BlockCache(BlockBackend *blockDevice, uint32_t blockSize, size_t budget) {
+    this->blockDevice = blockDevice;
+    this->blockSize = blockSize;
+    this->slotCount = budget / blockSize > BC_MIN_BLOCKS ? budget / blockSize : BC_MIN_BLOCKS;
+    this->slots = new Slot[this->slotCount];
+    for (unsigned int i = 0; i < this->slotCount; i++) {
+        this->slots[i].valid = false;
+        this->slots[i].dirty = false;
+        this->slots[i].referenced = false;
+    }
+    this->data = new char[(size_t) this->slotCount * blockSize];
+    this->index.reserve(this->slotCount);
+    this->hand = 0;
+    pthread_mutex_init(&this->lock, NULL);
+    this->writes = 0;
+    this->prefetchRunning = false;
+    this->prefetchStopping = false;
+    pthread_mutex_init(&this->prefetchLock, NULL);
+    pthread_cond_init(&this->prefetchCondition, NULL);
+    this->hits = 0;
+    this->misses = 0;
+    this->writeBacks = 0;
+    this->prefetched = 0;
+}
+
+BlockCache::~BlockCache() {
+    pthread_mutex_lock(&this->prefetchLock);
+    bool running = this->prefetchRunning;
+    this->prefetchStopping = true;
+    pthread_cond_signal(&this->prefetchCondition);
+    pthread_mutex_unlock(&this->prefetchLock);
+    if (running) {
+        pthread_join(this->prefetchThread, NULL);
+    }
+    pthread_mutex_destroy(&this->prefetchLock);
+    pthread_cond_destroy(&this->prefetchCondition);
+    delete[] this->slots;
+    delete[] this->data;
+    pthread_mutex_destroy(&this->lock);
+}
+
+char *BlockCache::slotData(unsigned int slot) {
+    return this->data + (size_t) slot * this->blockSize;
+}
+
+// this method returns the slot of a cached block or -1
+int BlockCache::lookup(uint64_t blockNo) {
+    std::unordered_map<uint64_t, unsigned int>::iterator it = this->index.find(blockNo);
+    return it == this->index.end() ? -1 : (int) it->second;
+}
+
+// this method frees a slot with the CLOCK algorithm, a dirty victim is written back together with the dirty blocks
+// among the next BC_EVICT_WRITE_BACK_SLOTS slots, which the hand reaches next
+int BlockCache::evict(unsigned int *slot) {
+    while (true) {
+        Slot *victim = &this->slots[this->hand];
+        if (victim->valid && victim->referenced) {
+            victim->referenced = false;
+            this->hand = (this->hand + 1) % this->slotCount;
+            continue;
+        }
+        if (victim->valid) {
+            if (victim->dirty) {
+                std::vector<unsigned int> dirty;
+                for (unsigned int k = 0; k < BC_EVICT_WRITE_BACK_SLOTS && k < this->slotCount; k++) {
+                    unsigned int candidate = (this->hand + k) % this->slotCount;
+                    if (this->slots[candidate].valid && this->slots[candidate].dirty) {
+                        dirty.push_back(candidate);
+                    }
+                }
+                int ret = writeBackLocked(dirty);
+                if (ret < 0) {
+                    return ret;
+                }
+            }
+            this->index.erase(victim->blockNo);
+            victim->valid = false;
+        }
+        *slot = this->hand;
+        this->hand = (this->hand + 1) % this->slotCount;
+        return 0;
+    }
+}
+
+int BlockCache::insert(uint64_t blockNo, const char *buffer, bool dirty) {
+    int found = lookup(blockNo);
+    unsigned int slot;
+    if (found >= 0) {
+        slot = found;
+    } else {
+        int ret = evict(&slot);
+        if (ret < 0) {
+            return ret;
+        }
+        this->slots[slot].blockNo = blockNo;
+        this->slots[slot].valid = true;
+        this->slots[slot].dirty = false;
+        this->index[blockNo] = slot;
+    }
+    memcpy(slotData(slot), buffer, this->blockSize);
+    this->slots[slot].dirty = this->slots[slot].dirty || dirty;
+    this->slots[slot].referenced = true;
+    if (dirty) {
+        this->writes++;
+    }
+    return 0;
+}
+
+int BlockCache::flushLocked() {
+    std::vector<unsigned int> dirty;
+    for (unsigned int i = 0; i < this->slotCount; i++) {
+        if (this->slots[i].valid && this->slots[i].dirty) {
+            dirty.push_back(i);
+        }
+    }
+    return writeBackLocked(dirty);
+}
+
+int BlockCache::writeBackLocked(std::vector<unsigned int> &dirty) {
+    if (dirty.empty()) {
+        return 0;
+    }
+    std::sort(dirty.begin(), dirty.end(), [this](unsigned int a, unsigned int b) {
+        return this->slots[a].blockNo < this->slots[b].blockNo;
+    });
+
+    // neighbouring blocks are written with one gather request
+    std::vector<struct iovec> iov(dirty.size());
+    BlockBatch batch(this->blockSize);
+    for (size_t runStart = 0, runEnd; runStart < dirty.size(); runStart = runEnd) {
+        iov[runStart].iov_base = slotData(dirty[runStart]);
+        iov[runStart].iov_len = this->blockSize;
+        for (runEnd = runStart + 1; runEnd < dirty.size() &&
+                                    this->slots[dirty[runEnd]].blockNo == this->slots[dirty[runEnd - 1]].blockNo + 1;
+             runEnd++) {
+            iov[runEnd].iov_base = slotData(dirty[runEnd]);
+            iov[runEnd].iov_len = this->blockSize;
+        }
+        batch.queueWritev(this->slots[dirty[runStart]].blockNo, &iov[runStart], runEnd - runStart);
+    }
+    int ret = this->blockDevice->submit(&batch);
+    if (ret >= 0) {
+        for (size_t i = 0; i < dirty.size(); i++) {
+            this->slots[dirty[i]].dirty = false;
+        }
+        this->writeBacks += dirty.size();
+        ret = 0;
+    }
+    return ret;
+}
+
+int BlockCache::read(uint64_t blockNo, char *buffer) {
+    return readBlocks(&blockNo, &buffer, 1);
+}
+
+int BlockCache::write(uint64_t blockNo, const char *buffer) {
+    pthread_mutex_lock(&this->lock);
+    int ret = insert(blockNo, buffer, true);
+    pthread_mutex_unlock(&this->lock);
+    return ret;
+}
+
+int BlockCache::readBlocks(const uint64_t *blocks, char **buffers, unsigned int count) {
+    pthread_mutex_lock(&this->lock);
+    std::vector<unsigned int> missing;
+    for (unsigned int j = 0; j < count; j++) {
+        int slot = lookup(blocks[j]);
+        if (slot >= 0) {
+            memcpy(buffers[j], slotData(slot), this->blockSize);
+            this->slots[slot].referenced = true;
+            this->hits++;
+        } else {
+            missing.push_back(j);
+        }
+    }
+
+    // all misses are read with one batch, neighbouring blocks with one scatter request
+    int ret = 0;
+    if (!missing.empty()) {
+        std::vector<struct iovec> iov(missing.size());
+        BlockBatch batch(this->blockSize);
+        for (size_t runStart = 0, runEnd; runStart < missing.size(); runStart = runEnd) {
+            iov[runStart].iov_base = buffers[missing[runStart]];
+            iov[runStart].iov_len = this->blockSize;
+            for (runEnd = runStart + 1; runEnd < missing.size() &&
+                                        blocks[missing[runEnd]] == blocks[missing[runEnd - 1]] + 1; runEnd++) {
+                iov[runEnd].iov_base = buffers[missing[runEnd]];
+                iov[runEnd].iov_len = this->blockSize;
+            }
+            batch.queueReadv(blocks[missing[runStart]], &iov[runStart], runEnd - runStart);
+        }
+        ret = this->blockDevice->submit(&batch);
+        this->misses += missing.size();
+        for (size_t k = 0; k < missing.size() && ret >= 0; k++) {
+            ret = insert(blocks[missing[k]], buffers[missing[k]], false);
+        }
+    }
+    pthread_mutex_unlock(&this->lock);
+    return ret < 0 ? ret : 0;
+}
+
+int BlockCache::writeBlocks(const uint64_t *blocks, char **buffers, unsigned int count) {
+    pthread_mutex_lock(&this->lock);
+    int ret = 0;
+    for (unsigned int j = 0; j < count && ret >= 0; j++) {
+        ret = insert(blocks[j], buffers[j], true);
+    }
+    pthread_mutex_unlock(&this->lock);
+    return ret;
+}
+
+int BlockCache::readBlocks(uint64_t firstBlock, uint64_t count, char *buffer) {
+    std::vector<uint64_t> blocks(count);
+    std::vector<char *> buffers(count);
+    for (uint64_t j = 0; j < count; j++) {
+        blocks[j] = firstBlock + j;
+        buffers[j] = buffer + j * this->blockSize;
+    }
+    return readBlocks(blocks.data(), buffers.data(), count);
+}
+
+int BlockCache::writeBlocks(uint64_t firstBlock, uint64_t count, char *buffer) {
+    std::vector<uint64_t> blocks(count);
+    std::vector<char *> buffers(count);
+    for (uint64_t j = 0; j < count; j++) {
+        blocks[j] = firstBlock + j;
+        buffers[j] = buffer + j * this->blockSize;
+    }
+    return writeBlocks(blocks.data(), buffers.data(), count);
+}
+
+void BlockCache::invalidate(uint64_t firstBlock, uint64_t count) {
+    pthread_mutex_lock(&this->lock);
+    for (uint64_t blockNo = firstBlock; blockNo < firstBlock + count; blockNo++) {
+        int slot = lookup(blockNo);
+        if (slot >= 0) {
+            this->slots[slot].valid = false;
+            this->slots[slot].dirty = false;
+            this->index.erase(blockNo);
+        }
+    }
+    // a running prefetch must not bring back the old content
+    this->writes++;
+    pthread_mutex_unlock(&this->lock);
+}
+
+int BlockCache::prefetch(const uint64_t *blocks, unsigned int count) {
+    std::vector<uint64_t> missing;
+    pthread_mutex_lock(&this->lock);
+    for (unsigned int j = 0; j < count; j++) {
+        if (lookup(blocks[j]) < 0) {
+            missing.push_back(blocks[j]);
+        }
+    }
+    uint64_t writesBefore = this->writes;
+    pthread_mutex_unlock(&this->lock);
+    if (missing.empty()) {
+        return 0;
+    }
+
+    // the missing blocks are read without holding the cache lock, neighbouring blocks with one request
+    char *buffer = new char[missing.size() * this->blockSize];
+    BlockBatch batch(this->blockSize);
+    for (size_t runStart = 0, runEnd; runStart < missing.size(); runStart = runEnd) {
+        for (runEnd = runStart + 1; runEnd < missing.size() && missing[runEnd] == missing[runEnd - 1] + 1; runEnd++);
+        batch.queueRead(missing[runStart], runEnd - runStart, buffer + runStart * this->blockSize);
+    }
+    int ret = this->blockDevice->submit(&batch);
+
+    pthread_mutex_lock(&this->lock);
+    if (ret >= 0 && writesBefore == this->writes) {
+        for (size_t k = 0; k < missing.size() && ret >= 0; k++) {
+            if (lookup(missing[k]) < 0) {
+                ret = insert(missing[k], buffer + k * this->blockSize, false);
+                this->slots[this->index[missing[k]]].referenced = false;
+                this->prefetched++;
+            }
+        }
+    }
+    pthread_mutex_unlock(&this->lock);
+    delete[] buffer;
+    return ret < 0 ? ret : 0;
+}
+
+void *BlockCache::prefetchMain(void *cache) {
+    BlockCache *self = (BlockCache *) cache;
+    std::vector<uint64_t> blocks;
+    pthread_mutex_lock(&self->prefetchLock);
+    while (!self->prefetchStopping) {
+        if (self->prefetchQueue.empty()) {
+            pthread_cond_wait(&self->prefetchCondition, &self->prefetchLock);
+            continue;
+        }
+        blocks.swap(self->prefetchQueue);
+        pthread_mutex_unlock(&self->prefetchLock);
+        self->prefetch(blocks.data(), blocks.size());
+        blocks.clear();
+        pthread_mutex_lock(&self->prefetchLock);
+    }
+    pthread_mutex_unlock(&self->prefetchLock);
+    return NULL;
+}
+
+void BlockCache::prefetchAsync(const uint64_t *blocks, unsigned int count) {
+    pthread_mutex_lock(&this->prefetchLock);
+    if (!this->prefetchRunning && !this->prefetchStopping) {
+        this->prefetchRunning = pthread_create(&this->prefetchThread, NULL, prefetchMain, this) == 0;
+    }
+    if (this->prefetchRunning && this->prefetchQueue.size() + count <= BC_PREFETCH_QUEUE_BLOCKS) {
+        this->prefetchQueue.insert(this->prefetchQueue.end(), blocks, blocks + count);
+        pthread_cond_signal(&this->prefetchCondition);
+        pthread_mutex_unlock(&this->prefetchLock);
+    } else {
+        // without a prefetch thread the blocks are read right away
+        bool running = this->prefetchRunning;
+        pthread_mutex_unlock(&this->prefetchLock);
+        if (!running) {
+            prefetch(blocks, count);
+        }
+    }
+}
+
+bool BlockCache::contains(uint64_t blockNo) {
+    pthread_mutex_lock(&this->lock);
+    bool found = lookup(blockNo) >= 0;
+    pthread_mutex_unlock(&this->lock);
+    return found;
+}
+
+int BlockCache::flush() {
+    pthread_mutex_lock(&this->lock);
+    int ret = flushLocked();
+    pthread_mutex_unlock(&this->lock);
+    return ret;
+}
+
+uint64_t BlockCache::getHits() {
+    return this->hits;
+}
+
+uint64_t BlockCache::getMisses() {
+    return this->misses;
+}
+
+uint64_t BlockCache::getWriteBacks() {
+    return this->writeBacks;
+}
+
+uint64_t BlockCache::getPrefetched() {
+    return this->prefetched;
+}
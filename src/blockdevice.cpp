@@ -6,13 +6,14 @@
 //  Copyright © 2017 Oliver Waldhorst. All rights reserved.
 //
 
-// DO NOT EDIT THIS FILE!!!
-
 #include <cstdlib>
+#include <cstring>
 #include <cassert>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include "macros.h"
@@ -21,27 +22,53 @@
 
 #undef DEBUG
 
-BlockDevice::BlockDevice(u_int32_t blockSize) {
-    assert(blockSize % 512 == 0);
-    this->blockSize = blockSize;
+BlockDevice::BlockDevice(u_int32_t blockSize) : BlockBackend(blockSize) {
+    this->mapped = false;
+    this->mapping = NULL;
+    this->mappingSize = 0;
+    pthread_rwlock_init(&this->mappingLock, NULL);
+    this->ring = NULL;
+    pthread_mutex_init(&this->ringLock, NULL);
+    this->direct = false;
+    pthread_rwlock_init(&this->directLock, NULL);
 }
 
-void BlockDevice::resize(u_int32_t blockSize) {
-    assert(blockSize % 512 == 0);
-    this->blockSize = blockSize;
+BlockDevice::~BlockDevice() {
+    unmap();
+    delete this->ring;
+    pthread_rwlock_destroy(&this->mappingLock);
+    pthread_mutex_destroy(&this->ringLock);
+    pthread_rwlock_destroy(&this->directLock);
 }
 
-int BlockDevice::create(const char *path) {
+// this method returns the file descriptor or -1 with errno set
+int BlockDevice::openContainer(const char *path, int openFlags, int flags) {
+
+    this->direct = false;
+    if (flags & BD_DIRECT_IO) {
+        int fd = ::open(path, openFlags | O_DIRECT, 0666);
+        if (fd >= 0 || errno != EINVAL) {
+            this->direct = fd >= 0;
+            return fd;
+        }
+        // the file system does not support O_DIRECT
+        LOG("WARNING: O_DIRECT not supported, using the page cache");
+    }
+
+    return ::open(path, openFlags, 0666);
+}
+
+int BlockDevice::create(const char *path, int flags) {
 
     int ret = 0;
 
     // Open Container file
-    contFile = ::open(path, O_EXCL | O_RDWR | O_CREAT, 0666);
+    contFile = openContainer(path, O_EXCL | O_RDWR | O_CREAT, flags);
     if (contFile < 0) {
         if (errno == EEXIST) {
             // file already exists, we must open & truncate
             LOG("WARNING: container file already exists, truncating")
-            contFile = ::open(path, O_EXCL | O_RDWR | O_TRUNC);
+            contFile = openContainer(path, O_EXCL | O_RDWR | O_TRUNC, flags);
         }
 
         if (contFile < 0) {
@@ -50,17 +77,18 @@ int BlockDevice::create(const char *path) {
         }
     }
 
-    this->size = 0;
+    if (ret == 0)
+        setupRing();
 
     return ret;
 }
 
-int BlockDevice::open(const char *path) {
+int BlockDevice::open(const char *path, int flags) {
 
     int ret = 0;
 
     // Open Container file
-    contFile = ::open(path, O_EXCL | O_RDWR);
+    contFile = openContainer(path, O_EXCL | O_RDWR, flags);
     if (contFile < 0) {
         if (errno == ENOENT)
                 LOG("ERROR: container file does not exists");
@@ -76,24 +104,26 @@ int BlockDevice::open(const char *path) {
         if (fstat(contFile, &st) < 0) {
             LOG("ERROR: fstat returned -1");
             ret = -errno;
-        } else {
-
-            // get file size
-            if (st.st_size > INT32_MAX) {
-                LOG("ERROR: file to large");
-                ret = -EFBIG;
-            } else
-                this->size = (uint32_t) st.st_size;
         }
     }
 
+    if (ret == 0)
+        setupRing();
+
     return ret;
 }
 
 
+bool BlockDevice::isDirect() {
+    return this->direct;
+}
+
 int BlockDevice::close() {
 
-    int ret = 0;
+    int ret = unmap();
+
+    delete this->ring;
+    this->ring = NULL;
 
     if (::close(this->contFile) < 0)
         ret = -errno;
@@ -102,50 +132,505 @@ int BlockDevice::close() {
 }
 
 // this method returns 0 if successful, -errno otherwise
-int BlockDevice::read(u_int32_t blockNo, char *buffer) {
+int BlockDevice::readv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
 #ifdef DEBUG
-    fprintf(stderr, "BlockDevice: Reading block %d\n", blockNo);
+    fprintf(stderr, "BlockDevice: Reading %d buffers from block %llu\n", iovcnt, (unsigned long long) firstBlock);
 #endif
-    off_t pos = (blockNo) * this->blockSize;
-    if (lseek(this->contFile, pos, SEEK_SET) != pos)
-        return -errno;
+    off_t pos = (off_t) firstBlock * this->blockSize;
+    size_t done = 0;
+    int i = 0;
+
+    if (this->mapped) {
+        pthread_rwlock_rdlock(&this->mappingLock);
+        for (i = 0; i < iovcnt; pos += iov[i].iov_len, i++) {
+            // blocks behind the mapping have never been written
+            size_t mappedLen = (size_t) pos >= this->mappingSize ? 0 : this->mappingSize - pos;
+            if (mappedLen > iov[i].iov_len)
+                mappedLen = iov[i].iov_len;
+            if (mappedLen > 0)
+                memcpy(iov[i].iov_base, this->mapping + pos, mappedLen);
+            memset((char *) iov[i].iov_base + mappedLen, 0, iov[i].iov_len - mappedLen);
+        }
+        pthread_rwlock_unlock(&this->mappingLock);
+        return 0;
+    }
 
-    int size = (this->blockSize);
-    if (::read(this->contFile, buffer, size) != size)
-        return -errno;
+    if (this->direct && !isDirectAligned(pos, iov, iovcnt))
+        return transferDirect(false, pos, iov, iovcnt);
+
+    while (i < iovcnt) {
+        ssize_t ret;
+        if (done == 0) {
+            ret = ::preadv(this->contFile, iov + i, iovcnt - i < IOV_MAX ? iovcnt - i : IOV_MAX, pos);
+        } else {
+            // continue a buffer which has been transferred partially
+            ret = ::pread(this->contFile, (char *) iov[i].iov_base + done, iov[i].iov_len - done, pos);
+        }
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -errno;
+        }
+        if (ret == 0) {
+            // end of container file reached, the remaining blocks have never been written
+            memset((char *) iov[i].iov_base + done, 0, iov[i].iov_len - done);
+            for (i++; i < iovcnt; i++)
+                memset(iov[i].iov_base, 0, iov[i].iov_len);
+            return 0;
+        }
+        pos += ret;
+        done += ret;
+        while (i < iovcnt && done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
+            i++;
+        }
+    }
 
     return 0;
 }
 
 // this method returns 0 if successful, -errno otherwise
-int BlockDevice::write(u_int32_t blockNo, char *buffer) {
+int BlockDevice::writev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
 #ifdef DEBUG
-    fprintf(stderr, "BlockDevice: Writing block %d\n", blockNo);
+    fprintf(stderr, "BlockDevice: Writing %d buffers to block %llu\n", iovcnt, (unsigned long long) firstBlock);
 #endif
-    off_t pos = (blockNo) * this->blockSize;
-    if (lseek(this->contFile, pos, SEEK_SET) != pos)
+    off_t pos = (off_t) firstBlock * this->blockSize;
+    size_t done = 0;
+    int i = 0;
+
+    if (this->mapped) {
+        size_t end = pos;
+        for (i = 0; i < iovcnt; i++)
+            end += iov[i].iov_len;
+        pthread_rwlock_rdlock(&this->mappingLock);
+        if (end > this->mappingSize) {
+            // the mapping only grows, after growing it the read lock is taken again
+            pthread_rwlock_unlock(&this->mappingLock);
+            pthread_rwlock_wrlock(&this->mappingLock);
+            int ret = growMapping(end);
+            pthread_rwlock_unlock(&this->mappingLock);
+            if (ret < 0)
+                return ret;
+            pthread_rwlock_rdlock(&this->mappingLock);
+        }
+        for (i = 0; i < iovcnt; pos += iov[i].iov_len, i++)
+            memcpy(this->mapping + pos, iov[i].iov_base, iov[i].iov_len);
+        pthread_rwlock_unlock(&this->mappingLock);
+        return 0;
+    }
+
+    if (this->direct && !isDirectAligned(pos, iov, iovcnt))
+        return transferDirect(true, pos, iov, iovcnt);
+
+    // an aligned O_DIRECT write must not land inside the read-modify-write of a partial sector
+    if (this->direct)
+        pthread_rwlock_rdlock(&this->directLock);
+
+    int ret = 0;
+    while (i < iovcnt) {
+        ssize_t written;
+        if (done == 0) {
+            written = ::pwritev(this->contFile, iov + i, iovcnt - i < IOV_MAX ? iovcnt - i : IOV_MAX, pos);
+        } else {
+            // continue a buffer which has been transferred partially
+            written = ::pwrite(this->contFile, (char *) iov[i].iov_base + done, iov[i].iov_len - done, pos);
+        }
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = -errno;
+            break;
+        }
+        if (written == 0) {
+            ret = -EIO;
+            break;
+        }
+        pos += written;
+        done += written;
+        while (i < iovcnt && done >= iov[i].iov_len) {
+            done -= iov[i].iov_len;
+            i++;
+        }
+    }
+
+    if (this->direct)
+        pthread_rwlock_unlock(&this->directLock);
+
+    return ret;
+}
+
+void BlockDevice::setupRing() {
+
+    delete this->ring;
+    this->ring = new BlockRing();
+    if (this->ring->setup(BD_RING_ENTRIES) < 0) {
+        // no io_uring, batches use positional I/O
+        LOG("WARNING: io_uring not available");
+        delete this->ring;
+        this->ring = NULL;
+    }
+}
+
+bool BlockDevice::hasRing() {
+    return this->ring != NULL;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::submit(BlockBatch *batch) {
+
+    int ret = 0;
+
+    bool useRing = this->ring != NULL && !this->mapped;
+    for (size_t r = 0; r < batch->requests.size() && useRing && this->direct; r++) {
+        // unaligned O_DIRECT requests have to be bounced
+        BlockBatch::Request &request = batch->requests[r];
+        useRing = isDirectAligned((off_t) request.firstBlock * this->blockSize, &batch->iovs[request.firstIov],
+                                  request.iovcnt);
+    }
+
+    if (!useRing)
+        return BlockBackend::submit(batch);
+
+    // aligned O_DIRECT writes of the batch must not land inside the read-modify-write of a partial sector, a short
+    // transfer completed by writev takes the read lock once more
+    if (this->direct)
+        pthread_rwlock_rdlock(&this->directLock);
+    ret = submitRing(batch);
+    if (this->direct)
+        pthread_rwlock_unlock(&this->directLock);
+    batch->clear();
+    return ret;
+}
+
+int BlockDevice::submitRing(BlockBatch *batch) {
+
+    int ret = 0;
+    size_t count = batch->requests.size();
+
+    pthread_mutex_lock(&this->ringLock);
+    for (size_t next = 0; next < count;) {
+        // fill the submission queue and hand it to the kernel with a single system call
+        unsigned int prepared = 0;
+        for (; next < count && prepared < this->ring->getEntries(); next++, prepared++) {
+            BlockBatch::Request &request = batch->requests[next];
+            this->ring->prepare(request.write, this->contFile, &batch->iovs[request.firstIov], request.iovcnt,
+                                (off_t) request.firstBlock * this->blockSize, next);
+        }
+        int submitRet = this->ring->submitAndWait(prepared);
+
+        // reap all completions of this round
+        unsigned int reaped = 0;
+        while (submitRet == 0 && reaped < prepared) {
+            uint64_t index;
+            int result;
+            if (this->ring->reap(&index, &result) < 0) {
+                // completion not yet visible, wait for it
+                submitRet = this->ring->submitAndWait(1);
+                continue;
+            }
+            reaped++;
+            BlockBatch::Request &request = batch->requests[index];
+            size_t expected = 0;
+            for (int i = 0; i < request.iovcnt; i++)
+                expected += batch->iovs[request.firstIov + i].iov_len;
+            if (result >= 0 && (size_t) result < expected) {
+                // short transfer, e.g. at the end of the container file, is completed with positional I/O
+                if (request.write)
+                    result = writev(request.firstBlock, &batch->iovs[request.firstIov], request.iovcnt);
+                else
+                    result = readv(request.firstBlock, &batch->iovs[request.firstIov], request.iovcnt);
+            }
+            if (result < 0 && ret == 0)
+                ret = result;
+        }
+        if (submitRet < 0) {
+            // requests still in flight use the buffers of the batch, which the caller frees after returning
+            int drainRet = this->ring->drain();
+            if (drainRet < 0)
+                LOG("ERROR: io_uring requests could not be drained");
+            ret = submitRet;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&this->ringLock);
+
+    return ret;
+}
+
+bool BlockDevice::isDirectAligned(off_t pos, const struct iovec *iov, int iovcnt) {
+
+    if (pos % BD_DIRECT_ALIGNMENT != 0)
+        return false;
+    for (int i = 0; i < iovcnt; i++) {
+        if ((uintptr_t) iov[i].iov_base % BD_DIRECT_ALIGNMENT != 0 || iov[i].iov_len % BD_DIRECT_ALIGNMENT != 0)
+            return false;
+    }
+    return true;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int BlockDevice::transferDirect(bool write, off_t pos, const struct iovec *iov, int iovcnt) {
+
+    size_t length = 0;
+    for (int i = 0; i < iovcnt; i++)
+        length += iov[i].iov_len;
+
+    char *bounce = this->directBuffers.get();
+    if (bounce == NULL)
+        return -ENOMEM;
+
+    // partially covered sectors are read, modified and written, which must not interleave with other writers
+    if (write)
+        pthread_rwlock_wrlock(&this->directLock);
+
+    int ret = 0;
+    off_t end = pos + length;
+    off_t chunkStart = pos - pos % BD_DIRECT_ALIGNMENT;
+    int i = 0;
+    size_t iovDone = 0;
+    while (chunkStart < end && ret == 0) {
+        off_t chunkEnd = chunkStart + BD_DIRECT_BUFFER_SIZE;
+        if (chunkEnd > end)
+            chunkEnd = (end + BD_DIRECT_ALIGNMENT - 1) / BD_DIRECT_ALIGNMENT * BD_DIRECT_ALIGNMENT;
+        size_t chunkLength = chunkEnd - chunkStart;
+        off_t from = pos > chunkStart ? pos : chunkStart;
+        off_t to = end < chunkEnd ? end : chunkEnd;
+
+        if (!write || from > chunkStart || to < chunkEnd) {
+            ssize_t got = ::pread(this->contFile, bounce, chunkLength, chunkStart);
+            if (got < 0) {
+                ret = -errno;
+                break;
+            }
+            // sectors behind the end of the container file have never been written
+            memset(bounce + got, 0, chunkLength - got);
+        }
+
+        // copy between the bounce buffer and the caller's buffers
+        for (off_t copied = from; copied < to;) {
+            size_t n = iov[i].iov_len - iovDone;
+            if ((off_t) n > to - copied)
+                n = to - copied;
+            if (write)
+                memcpy(bounce + (copied - chunkStart), (char *) iov[i].iov_base + iovDone, n);
+            else
+                memcpy((char *) iov[i].iov_base + iovDone, bounce + (copied - chunkStart), n);
+            copied += n;
+            iovDone += n;
+            if (iovDone == iov[i].iov_len) {
+                i++;
+                iovDone = 0;
+            }
+        }
+
+        if (write) {
+            ssize_t written = ::pwrite(this->contFile, bounce, chunkLength, chunkStart);
+            if (written < 0)
+                ret = -errno;
+            else if (written != (ssize_t) chunkLength)
+                ret = -EIO;
+        }
+        chunkStart = chunkEnd;
+    }
+
+    if (write)
+        pthread_rwlock_unlock(&this->directLock);
+    this->directBuffers.put(bounce);
+
+    return ret;
+}
+
+int BlockDevice::map() {
+
+    if (this->direct)
+        return -EINVAL;
+
+    struct stat st;
+    if (fstat(this->contFile, &st) < 0)
         return -errno;
 
-    int __size = (this->blockSize);
-    if (::write(this->contFile, buffer, __size) != __size)
+    pthread_rwlock_wrlock(&this->mappingLock);
+    int ret = 0;
+    if (!this->mapped && st.st_size > 0) {
+        this->mapping = (char *) mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, this->contFile, 0);
+        if (this->mapping == MAP_FAILED) {
+            this->mapping = NULL;
+            ret = -errno;
+        } else
+            this->mappingSize = st.st_size;
+    }
+    if (ret == 0)
+        this->mapped = true;
+    pthread_rwlock_unlock(&this->mappingLock);
+
+    return ret;
+}
+
+int BlockDevice::unmap() {
+
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&this->mappingLock);
+    if (this->mapping != NULL && munmap(this->mapping, this->mappingSize) < 0)
+        ret = -errno;
+    this->mapping = NULL;
+    this->mappingSize = 0;
+    this->mapped = false;
+    pthread_rwlock_unlock(&this->mappingLock);
+
+    return ret;
+}
+
+// must be called with the mapping lock held for writing
+int BlockDevice::growMapping(size_t minSize) {
+
+    if (minSize <= this->mappingSize)
+        return 0;
+
+    // grow in larger steps, the container file stays sparse until the blocks are written
+    size_t newSize = (minSize + BD_MAP_GROW_SIZE - 1) / BD_MAP_GROW_SIZE * BD_MAP_GROW_SIZE;
+
+    struct stat st;
+    if (fstat(this->contFile, &st) < 0)
+        return -errno;
+    if ((size_t) st.st_size < newSize && ftruncate(this->contFile, newSize) < 0)
+        return -errno;
+
+    char *newMapping;
+    if (this->mapping == NULL)
+        newMapping = (char *) mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->contFile, 0);
+    else {
+#ifdef __linux__
+        newMapping = (char *) mremap(this->mapping, this->mappingSize, newSize, MREMAP_MAYMOVE);
+#else
+        if (munmap(this->mapping, this->mappingSize) < 0)
+            return -errno;
+        this->mapping = NULL;
+        this->mappingSize = 0;
+        newMapping = (char *) mmap(NULL, newSize, PROT_READ | PROT_WRITE, MAP_SHARED, this->contFile, 0);
+#endif
+    }
+    if (newMapping == MAP_FAILED)
         return -errno;
 
+    this->mapping = newMapping;
+    this->mappingSize = newSize;
+
     return 0;
 }
 
-uint32_t BlockDevice::getSize() {
+char *BlockDevice::getBlockPointer(uint64_t blockNo) {
 
-    // update size from file stats
-    struct stat st;
-    if (fstat(contFile, &st) < 0) {
-        LOG("ERROR: fstat returned -1");
+    size_t pos = (size_t) blockNo * this->blockSize;
+    char *pointer = NULL;
+
+    pthread_rwlock_rdlock(&this->mappingLock);
+    if (this->mapped && pos + this->blockSize <= this->mappingSize)
+        pointer = this->mapping + pos;
+    pthread_rwlock_unlock(&this->mappingLock);
+
+    return pointer;
+}
+
+int BlockDevice::willNeed(uint64_t firstBlock, uint64_t count) {
+
+    int ret = 0;
+    size_t pos = (size_t) firstBlock * this->blockSize;
+    size_t len = (size_t) count * this->blockSize;
+
+    pthread_rwlock_rdlock(&this->mappingLock);
+    if (this->mapping != NULL) {
+        // madvise takes a page aligned address, blocks behind the mapping have never been written
+        size_t start = pos / (size_t) sysconf(_SC_PAGESIZE) * (size_t) sysconf(_SC_PAGESIZE);
+        if (pos + len > this->mappingSize)
+            len = pos < this->mappingSize ? this->mappingSize - pos : 0;
+        if (len > 0 && madvise(this->mapping + start, pos + len - start, MADV_WILLNEED) < 0)
+            ret = -errno;
+    } else
+        ret = -posix_fadvise(this->contFile, (off_t) pos, (off_t) len, POSIX_FADV_WILLNEED);
+    pthread_rwlock_unlock(&this->mappingLock);
+
+    return ret;
+}
+
+int BlockDevice::discard(uint64_t firstBlock, uint64_t count) {
+
+    if (count == 0)
+        return 0;
+
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // the host zeroes the partial units at both ends of the hole
+    if (fallocate(this->contFile, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) firstBlock * this->blockSize,
+                  (off_t) count * this->blockSize) < 0)
+        return -errno;
+    return 0;
+#else
+    return -EOPNOTSUPP;
+#endif
+}
+
+int BlockDevice::sync() {
+
+    int ret = 0;
+
+    pthread_rwlock_rdlock(&this->mappingLock);
+    if (this->mapping != NULL) {
+        if (msync(this->mapping, this->mappingSize, MS_SYNC) < 0)
+            ret = -errno;
+    } else if (fdatasync(this->contFile) < 0)
+        ret = -errno;
+    pthread_rwlock_unlock(&this->mappingLock);
+
+    return ret;
+}
+
+AlignedBufferPool::AlignedBufferPool() {
+    pthread_mutex_init(&this->lock, NULL);
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (size_t i = 0; i < this->buffers.size(); i++)
+        free(this->buffers[i]);
+    pthread_mutex_destroy(&this->lock);
+}
+
+char *AlignedBufferPool::get() {
+
+    char *buffer = NULL;
+
+    pthread_mutex_lock(&this->lock);
+    if (!this->buffers.empty()) {
+        buffer = this->buffers.back();
+        this->buffers.pop_back();
     }
+    pthread_mutex_unlock(&this->lock);
+
+    if (buffer == NULL && posix_memalign((void **) &buffer, BD_DIRECT_ALIGNMENT, BD_DIRECT_BUFFER_SIZE) != 0)
+        buffer = NULL;
 
-    if (st.st_size > UINT32_MAX)
-            LOG("ERROR: file to large");
-    this->size = (uint32_t) st.st_size;
+    return buffer;
+}
+
+void AlignedBufferPool::put(char *buffer) {
 
-    return this->size;
+    pthread_mutex_lock(&this->lock);
+    if (this->buffers.size() < BD_DIRECT_BUFFERS) {
+        this->buffers.push_back(buffer);
+        buffer = NULL;
+    }
+    pthread_mutex_unlock(&this->lock);
+
+    free(buffer);
 }
 
+uint64_t BlockDevice::getSize() {
+
+    // read size from file stats, nothing is cached so concurrent callers see the current size
+    struct stat st;
+    if (fstat(contFile, &st) < 0) {
+        LOG("ERROR: fstat returned -1");
+        return 0;
+    }
 
+    return (uint64_t) st.st_size;
+}
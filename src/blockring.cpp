@@ -0,0 +1,208 @@
+//
+//  blockring.cpp
+//  myfs
+//
+
+#include <cstring>
+#include <errno.h>
+#include <unistd.h>
+
+#include "blockring.h"
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+static int ioUringSetup(unsigned int entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int ioUringEnter(int fd, unsigned int toSubmit, unsigned int minComplete, unsigned int flags) {
+    return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+#endif
+
+BlockRing::BlockRing() {
+    this->ringFd = -1;
+    this->entries = 0;
+    this->pending = 0;
+    this->inFlight = 0;
+    this->sqRing = NULL;
+    this->sqRingSize = 0;
+    this->sqes = NULL;
+    this->sqesSize = 0;
+    this->cqRing = NULL;
+    this->cqRingSize = 0;
+}
+
+BlockRing::~BlockRing() {
+#ifdef HAVE_IO_URING
+    if (this->sqes != NULL)
+        munmap(this->sqes, this->sqesSize);
+    if (this->cqRing != NULL && this->cqRing != this->sqRing)
+        munmap(this->cqRing, this->cqRingSize);
+    if (this->sqRing != NULL)
+        munmap(this->sqRing, this->sqRingSize);
+#endif
+    if (this->ringFd >= 0)
+        ::close(this->ringFd);
+}
+
+int BlockRing::setup(unsigned int entries) {
+#ifdef HAVE_IO_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    this->ringFd = ioUringSetup(entries, &params);
+    if (this->ringFd < 0)
+        return -errno;
+
+    this->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    this->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && this->cqRingSize > this->sqRingSize)
+        this->sqRingSize = this->cqRingSize;
+
+    this->sqRing = mmap(NULL, this->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        this->ringFd, IORING_OFF_SQ_RING);
+    if (this->sqRing == MAP_FAILED) {
+        this->sqRing = NULL;
+        return -errno;
+    }
+    if (singleMmap) {
+        this->cqRing = this->sqRing;
+    } else {
+        this->cqRing = mmap(NULL, this->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            this->ringFd, IORING_OFF_CQ_RING);
+        if (this->cqRing == MAP_FAILED) {
+            this->cqRing = NULL;
+            return -errno;
+        }
+    }
+    this->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    this->sqes = mmap(NULL, this->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      this->ringFd, IORING_OFF_SQES);
+    if (this->sqes == MAP_FAILED) {
+        this->sqes = NULL;
+        return -errno;
+    }
+
+    char *sq = (char *) this->sqRing;
+    this->sqHead = (unsigned int *) (sq + params.sq_off.head);
+    this->sqTail = (unsigned int *) (sq + params.sq_off.tail);
+    this->sqMask = (unsigned int *) (sq + params.sq_off.ring_mask);
+    this->sqArray = (unsigned int *) (sq + params.sq_off.array);
+    char *cq = (char *) this->cqRing;
+    this->cqHead = (unsigned int *) (cq + params.cq_off.head);
+    this->cqTail = (unsigned int *) (cq + params.cq_off.tail);
+    this->cqMask = (unsigned int *) (cq + params.cq_off.ring_mask);
+    this->cqes = cq + params.cq_off.cqes;
+    this->entries = params.sq_entries;
+
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+unsigned int BlockRing::getEntries() {
+    return this->entries;
+}
+
+int BlockRing::prepare(bool write, int fd, const struct iovec *iov, int iovcnt, off_t offset, uint64_t userData) {
+#ifdef HAVE_IO_URING
+    unsigned int tail = *this->sqTail;
+    if (tail - __atomic_load_n(this->sqHead, __ATOMIC_ACQUIRE) >= this->entries)
+        return -EBUSY;
+
+    unsigned int index = tail & *this->sqMask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) this->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = write ? IORING_OP_WRITEV : IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (uint64_t) (uintptr_t) iov;
+    sqe->len = iovcnt;
+    sqe->user_data = userData;
+    this->sqArray[index] = index;
+
+    // publish the entry before the kernel may see the new tail
+    __atomic_store_n(this->sqTail, tail + 1, __ATOMIC_RELEASE);
+    this->pending++;
+
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+int BlockRing::submitAndWait(unsigned int waitCount) {
+#ifdef HAVE_IO_URING
+    while (this->pending > 0 || waitCount > 0) {
+        int ret = ioUringEnter(this->ringFd, this->pending, waitCount, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            return -errno;
+        }
+        this->pending -= ret;
+        this->inFlight += ret;
+
+        // completions which are already available need not be waited for again
+        unsigned int available = __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE) - *this->cqHead;
+        if (this->pending == 0 && available >= waitCount)
+            break;
+    }
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+int BlockRing::reap(uint64_t *userData, int *result) {
+#ifdef HAVE_IO_URING
+    unsigned int head = *this->cqHead;
+    if (head == __atomic_load_n(this->cqTail, __ATOMIC_ACQUIRE))
+        return -EAGAIN;
+
+    struct io_uring_cqe *cqe = (struct io_uring_cqe *) this->cqes + (head & *this->cqMask);
+    *userData = cqe->user_data;
+    *result = cqe->res;
+    __atomic_store_n(this->cqHead, head + 1, __ATOMIC_RELEASE);
+    this->inFlight--;
+
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
+
+int BlockRing::drain() {
+#ifdef HAVE_IO_URING
+    // the kernel consumes submission entries only inside io_uring_enter, unsubmitted entries can be taken back
+    __atomic_store_n(this->sqTail, *this->sqHead, __ATOMIC_RELEASE);
+    this->pending = 0;
+
+    while (this->inFlight > 0) {
+        uint64_t userData;
+        int result;
+        if (reap(&userData, &result) == 0)
+            continue;
+        int ret = ioUringEnter(this->ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+            return -errno;
+    }
+    return 0;
+#else
+    return -ENOSYS;
+#endif
+}
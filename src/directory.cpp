@@ -0,0 +1,117 @@
+//
+//  directory.cpp
+//  myfs
+//
+
+#include <cstring>
+
+#include "directory.h"
+#include "diskformat.h"
+
+// size of an entry without its name
+#define DIRECTORY_ENTRY_SIZE 5
+
+DirectoryBlock::DirectoryBlock(char *data, unsigned int blockSize) {
+    this->data = data;
+    this->blockSize = blockSize;
+}
+
+// FNV-1a, the hash is part of the on-disk format
+uint32_t DirectoryBlock::hashName(const char *name, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+uint32_t DirectoryBlock::getUsed() {
+    uint32_t used;
+    decodeUInt32(this->data + 4, &used);
+    return used;
+}
+
+void DirectoryBlock::setHeader(uint32_t count, uint32_t used) {
+    encodeUInt32(encodeUInt32(this->data, count), used);
+}
+
+void DirectoryBlock::clear() {
+    memset(this->data, 0, this->blockSize);
+    setHeader(0, DIRECTORY_HEADER_SIZE);
+}
+
+unsigned int DirectoryBlock::getCount() {
+    uint32_t count;
+    decodeUInt32(this->data, &count);
+    return count;
+}
+
+// returns the offset of the entry of name or 0
+unsigned int DirectoryBlock::findOffset(const char *name, size_t length) {
+    unsigned int offset = DIRECTORY_HEADER_SIZE;
+    int rootIndex;
+    const char *entryName;
+    size_t entryLength;
+    for (unsigned int entry = offset; next(&offset, &rootIndex, &entryName, &entryLength); entry = offset) {
+        if (entryLength == length && memcmp(entryName, name, length) == 0) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+int DirectoryBlock::find(const char *name, size_t length) {
+    unsigned int offset = findOffset(name, length);
+    if (offset == 0) {
+        return -1;
+    }
+    int32_t rootIndex;
+    decodeInt32(this->data + offset, &rootIndex);
+    return rootIndex;
+}
+
+bool DirectoryBlock::insert(const char *name, size_t length, int rootIndex) {
+    uint32_t used = getUsed();
+    if (used + DIRECTORY_ENTRY_SIZE + length > this->blockSize) {
+        return false;
+    }
+    char *entry = this->data + used;
+    encodeInt32(entry, rootIndex);
+    entry[4] = (char) length;
+    memcpy(entry + DIRECTORY_ENTRY_SIZE, name, length);
+    setHeader(getCount() + 1, used + DIRECTORY_ENTRY_SIZE + length);
+    return true;
+}
+
+bool DirectoryBlock::remove(const char *name, size_t length) {
+    unsigned int offset = findOffset(name, length);
+    if (offset == 0) {
+        return false;
+    }
+    //Closing the gap, the entries stay packed
+    uint32_t used = getUsed();
+    unsigned int size = DIRECTORY_ENTRY_SIZE + length;
+    memmove(this->data + offset, this->data + offset + size, used - offset - size);
+    used -= size;
+    memset(this->data + used, 0, size);
+    setHeader(getCount() - 1, used);
+    return true;
+}
+
+bool DirectoryBlock::next(unsigned int *offset, int *rootIndex, const char **name, size_t *length) {
+    if (*offset == 0) {
+        *offset = DIRECTORY_HEADER_SIZE;
+    }
+    if (*offset + DIRECTORY_ENTRY_SIZE > getUsed()) {
+        return false;
+    }
+    char *entry = this->data + *offset;
+    int32_t index;
+    decodeInt32(entry, &index);
+    *rootIndex = index;
+    *length = (unsigned char) entry[4];
+    *name = entry + DIRECTORY_ENTRY_SIZE;
+    *offset += DIRECTORY_ENTRY_SIZE + *length;
+    return true;
+}
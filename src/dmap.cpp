@@ -0,0 +1,113 @@
+//
+//  dmap.cpp
+//  myfs
+//
+
+#include <cstring>
+
+#include "dmap.h"
+
+DMap::DMap() {
+    clear();
+}
+
+void DMap::clear() {
+    memset(this->words, 0, sizeof(this->words));
+    load();
+}
+
+void DMap::load() {
+    this->freeCount = 0;
+    memset(this->summary, 0, sizeof(this->summary));
+    for (unsigned int w = 0; w < DMAP_WORDS; w++) {
+        this->freeCount += 64 - __builtin_popcountll(this->words[w]);
+        updateSummary(w);
+    }
+}
+
+char *DMap::getData() {
+    return (char *) this->words;
+}
+
+void DMap::updateSummary(unsigned int word) {
+    if (~this->words[word] != 0) {
+        this->summary[word / 64] |= 1ULL << (word % 64);
+    } else {
+        this->summary[word / 64] &= ~(1ULL << (word % 64));
+    }
+}
+
+bool DMap::isUsed(unsigned int block) {
+    return (this->words[block / 64] >> (block % 64)) & 1;
+}
+
+void DMap::setUsed(unsigned int block) {
+    if (!isUsed(block)) {
+        this->words[block / 64] |= 1ULL << (block % 64);
+        this->freeCount--;
+        updateSummary(block / 64);
+    }
+}
+
+void DMap::setFree(unsigned int block) {
+    if (isUsed(block)) {
+        this->words[block / 64] &= ~(1ULL << (block % 64));
+        this->freeCount++;
+        updateSummary(block / 64);
+    }
+}
+
+unsigned int DMap::getFreeCount() {
+    return this->freeCount;
+}
+
+// returns the first free block in [from, to) or -1
+int DMap::findFreeBetween(unsigned int from, unsigned int to) {
+    if (from >= to) {
+        return -1;
+    }
+    unsigned int w = from / 64;
+    uint64_t free = ~this->words[w] & (~0ULL << (from % 64));
+    if (free == 0) {
+        //Skipping full words with the summary
+        w++;
+        free = 0;
+        for (unsigned int s = w / 64; s < DMAP_SUMMARY_WORDS && free == 0; s++) {
+            uint64_t candidates = this->summary[s];
+            if (s == w / 64) {
+                candidates &= ~0ULL << (w % 64);
+            }
+            if (candidates != 0) {
+                w = s * 64 + __builtin_ctzll(candidates);
+                free = ~this->words[w];
+            }
+        }
+        if (free == 0) {
+            return -1;
+        }
+    }
+    unsigned int block = w * 64 + __builtin_ctzll(free);
+    return block < to ? (int) block : -1;
+}
+
+// returns the first used block in [from, to) or to
+unsigned int DMap::findUsedFrom(unsigned int from, unsigned int to) {
+    unsigned int w = from / 64;
+    uint64_t used = this->words[w] & (~0ULL << (from % 64));
+    while (used == 0 && ++w < DMAP_WORDS && w * 64 < to) {
+        used = this->words[w];
+    }
+    if (used == 0) {
+        return to;
+    }
+    unsigned int block = w * 64 + __builtin_ctzll(used);
+    return block < to ? block : to;
+}
+
+int DMap::findNextFreeRun(unsigned int from, unsigned int *length) {
+    int start = findFreeBetween(from, D_Map_SIZE);
+    if (start >= 0) {
+        *length = findUsedFrom(start, D_Map_SIZE) - start;
+    }
+    return start;
+}
@@ -0,0 +1,145 @@
+//
+//  freeextents.cpp
+//  myfs
+//
+
+#include "freeextents.h"
+
+FreeExtents::FreeExtents() {
+    this->freeCount = 0;
+}
+
+void FreeExtents::load(DMap *dMap) {
+    this->byStart.clear();
+    this->byLength.clear();
+    this->freeCount = 0;
+    unsigned int length;
+    for (int first = dMap->findNextFreeRun(0, &length); first >= 0;
+         first = dMap->findNextFreeRun(first + length, &length)) {
+        insert(first, length);
+    }
+}
+
+unsigned int FreeExtents::getFreeCount() {
+    return this->freeCount;
+}
+
+unsigned int FreeExtents::getExtentCount() {
+    return this->byStart.size();
+}
+
+bool FreeExtents::find(unsigned int block, unsigned int *first, unsigned int *count) {
+    std::map<unsigned int, unsigned int>::iterator extent = this->byStart.upper_bound(block);
+    if (extent == this->byStart.begin()) {
+        return false;
+    }
+    extent--;
+    if (block >= extent->first + extent->second) {
+        return false;
+    }
+    *first = extent->first;
+    *count = extent->second;
+    return true;
+}
+
+// adds a free extent, the caller merges it with its neighbours
+void FreeExtents::insert(unsigned int first, unsigned int count) {
+    this->byStart[first] = count;
+    this->byLength.insert(std::make_pair(count, first));
+    this->freeCount += count;
+}
+
+// removes count blocks starting at first from the free extent holding them
+void FreeExtents::take(unsigned int first, unsigned int count) {
+    std::map<unsigned int, unsigned int>::iterator extent = --this->byStart.upper_bound(first);
+    unsigned int start = extent->first;
+    unsigned int length = extent->second;
+    this->byLength.erase(std::make_pair(length, start));
+    this->byStart.erase(extent);
+    this->freeCount -= length;
+    if (first > start) {
+        insert(start, first - start);
+    }
+    if (first + count < start + length) {
+        insert(first + count, start + length - first - count);
+    }
+}
+
+bool FreeExtents::assign(unsigned int count, int goal, int *blocks) {
+    if (count > this->freeCount) {
+        return false;
+    }
+    unsigned int assigned = 0;
+    //Taking the free blocks starting at the goal
+    if (goal >= 0 && !this->byStart.empty()) {
+        std::map<unsigned int, unsigned int>::iterator extent = this->byStart.upper_bound(goal);
+        if (extent != this->byStart.begin()) {
+            --extent;
+            if (extent->first + extent->second > (unsigned int) goal) {
+                unsigned int n = extent->first + extent->second - goal;
+                n = n < count ? n : count;
+                take(goal, n);
+                for (; assigned < n; assigned++) {
+                    blocks[assigned] = goal + assigned;
+                }
+            }
+        }
+    }
+    while (assigned < count) {
+        unsigned int remaining = count - assigned;
+        unsigned int first = 0;
+        unsigned int n = 0;
+        //A free extent close behind the goal
+        if (goal >= 0) {
+            std::map<unsigned int, unsigned int>::iterator extent = this->byStart.lower_bound(goal);
+            for (int i = 0; i < FREE_EXTENTS_GOAL_SEARCH && extent != this->byStart.end(); i++, ++extent) {
+                if (extent->second >= remaining) {
+                    first = extent->first;
+                    n = remaining;
+                    break;
+                }
+            }
+        }
+        //The best fit, or the largest free extent if none is large enough
+        if (n == 0) {
+            std::set<std::pair<unsigned int, unsigned int> >::iterator extent =
+                    this->byLength.lower_bound(std::make_pair(remaining, 0u));
+            if (extent == this->byLength.end()) {
+                --extent;
+            }
+            first = extent->second;
+            n = extent->first < remaining ? extent->first : remaining;
+        }
+        take(first, n);
+        for (unsigned int j = 0; j < n; j++) {
+            blocks[assigned++] = first + j;
+        }
+    }
+    return true;
+}
+
+void FreeExtents::release(unsigned int first, unsigned int count) {
+    if (count == 0) {
+        return;
+    }
+    //Merging with the free extents before and behind
+    std::map<unsigned int, unsigned int>::iterator next = this->byStart.lower_bound(first);
+    if (next != this->byStart.begin()) {
+        std::map<unsigned int, unsigned int>::iterator previous = next;
+        --previous;
+        if (previous->first + previous->second == first) {
+            first = previous->first;
+            count += previous->second;
+            this->byLength.erase(std::make_pair(previous->second, previous->first));
+            this->freeCount -= previous->second;
+            this->byStart.erase(previous);
+        }
+    }
+    if (next != this->byStart.end() && next->first == first + count) {
+        count += next->second;
+        this->byLength.erase(std::make_pair(next->second, next->first));
+        this->freeCount -= next->second;
+        this->byStart.erase(next);
+    }
+    insert(first, count);
+}
@@ -0,0 +1,146 @@
+//
+//  journal.cpp
+//  myfs
+//
+
+#include <cerrno>
+#include <cstring>
+
+#include "diskformat.h"
+#include "journal.h"
+
+// FNV-1a
+static uint64_t hashBytes(uint64_t hash, const char *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+Journal::Journal(BlockBackend *blockDevice, unsigned int blockSize, uint64_t journalStart,
+                 unsigned int journalBlocks, unsigned int maxBlocks) {
+    this->blockDevice = blockDevice;
+    this->blockSize = blockSize;
+    this->journalStart = journalStart;
+    this->journalBlocks = journalBlocks;
+    this->maxBlocks = maxBlocks;
+    this->commits = 0;
+    reset(1);
+}
+
+void Journal::reset(uint64_t sequence) {
+    this->position = 0;
+    this->sequence = sequence;
+}
+
+uint64_t Journal::getSequence() {
+    return this->sequence;
+}
+
+uint64_t Journal::getCommits() {
+    return this->commits;
+}
+
+unsigned int Journal::getDescriptorBlocks(unsigned int blockSize, unsigned int count) {
+    return (JOURNAL_HEADER_SIZE + (size_t) count * sizeof(uint64_t) + blockSize - 1) / blockSize;
+}
+
+bool Journal::isFull() {
+    return this->position + getDescriptorBlocks(this->blockSize, this->maxBlocks) + this->maxBlocks >
+           this->journalBlocks;
+}
+
+// checksum of a transaction, the checksum field of its descriptor has to be zero
+uint64_t Journal::checksum(char *transaction, unsigned int blocks) {
+    return hashBytes(14695981039346656037ULL, transaction, (size_t) blocks * this->blockSize);
+}
+
+int Journal::commit(const uint64_t *blocks, char **buffers, unsigned int count) {
+    unsigned int descriptorBlocks = getDescriptorBlocks(this->blockSize, count);
+    if (count > this->maxBlocks || this->position + descriptorBlocks + count > this->journalBlocks) {
+        return -ENOSPC;
+    }
+    //Descriptor blocks and block images are written with one request
+    size_t descriptorSize = (size_t) descriptorBlocks * this->blockSize;
+    char *transaction = new char[descriptorSize + (size_t) count * this->blockSize];
+    memset(transaction, 0, descriptorSize);
+    char *position = encodeUInt32(transaction, JOURNAL_MAGIC);
+    position = encodeUInt32(position, count);
+    encodeUInt64(position, this->sequence);
+    position = transaction + JOURNAL_HEADER_SIZE;
+    for (unsigned int i = 0; i < count; i++) {
+        position = encodeUInt64(position, blocks[i]);
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        memcpy(transaction + descriptorSize + (size_t) i * this->blockSize, buffers[i], this->blockSize);
+    }
+    encodeUInt64(transaction + JOURNAL_CHECKSUM_OFFSET, checksum(transaction, descriptorBlocks + count));
+    int ret = this->blockDevice->writeBlocks(this->journalStart + this->position, descriptorBlocks + count,
+                                             transaction);
+    delete[] transaction;
+    if (ret >= 0) {
+        ret = this->blockDevice->sync();
+    }
+    if (ret >= 0) {
+        this->position += descriptorBlocks + count;
+        this->sequence++;
+        this->commits++;
+    }
+    return ret;
+}
+
+int Journal::replay(uint64_t sequence) {
+    this->sequence = sequence;
+    this->position = 0;
+    int replayed = 0;
+    unsigned int maxDescriptorBlocks = getDescriptorBlocks(this->blockSize, this->maxBlocks);
+    char *transaction = new char[(size_t) (maxDescriptorBlocks + this->maxBlocks) * this->blockSize];
+    int ret = 0;
+    while (this->position < this->journalBlocks) {
+        ret = this->blockDevice->read(this->journalStart + this->position, transaction);
+        if (ret < 0) {
+            break;
+        }
+        uint32_t magic, count;
+        uint64_t sequence, expected;
+        const char *position = decodeUInt32(transaction, &magic);
+        position = decodeUInt32(position, &count);
+        position = decodeUInt64(position, &sequence);
+        decodeUInt64(position, &expected);
+        if (magic != JOURNAL_MAGIC || sequence != this->sequence || count == 0 || count > this->maxBlocks) {
+            break;
+        }
+        unsigned int descriptorBlocks = getDescriptorBlocks(this->blockSize, count);
+        if (this->position + descriptorBlocks + count > this->journalBlocks) {
+            break;
+        }
+        ret = this->blockDevice->readBlocks(this->journalStart + this->position + 1, descriptorBlocks - 1 + count,
+                                            transaction + this->blockSize);
+        if (ret < 0) {
+            break;
+        }
+        encodeUInt64(transaction + JOURNAL_CHECKSUM_OFFSET, 0);
+        if (checksum(transaction, descriptorBlocks + count) != expected) {
+            break;
+        }
+        //Writing the block images home in the order they were logged
+        position = transaction + JOURNAL_HEADER_SIZE;
+        char *images = transaction + (size_t) descriptorBlocks * this->blockSize;
+        BlockBatch batch(this->blockSize);
+        for (unsigned int i = 0; i < count; i++) {
+            uint64_t block;
+            position = decodeUInt64(position, &block);
+            batch.queueWrite(block, 1, images + (size_t) i * this->blockSize);
+        }
+        ret = this->blockDevice->submit(&batch);
+        if (ret < 0) {
+            break;
+        }
+        this->position += descriptorBlocks + count;
+        this->sequence++;
+        replayed++;
+    }
+    delete[] transaction;
+    return ret < 0 ? ret : replayed;
+}
@@ -7,6 +7,7 @@
 
 #include <cerrno>
 #include <cstring>
+#include <cstdlib>
 #include <unistd.h>
 #include <iostream>
 #include "myfs.h"
@@ -14,34 +15,61 @@
 #include "macros.h"
 #include <libgen.h>
 #include <ctime>
+#include <set>
+#include <string>
+#include <vector>
 
 using namespace std;
 
+//Number of blocks copied from an input file into the container with one write request
+#define COPY_BLOCKS 256
+
 BlockDevice *blockDevice;
 SuperBlock *superBlock;
-MyFile *root[NUM_DIR_ENTRIES];
-char dMap[DATA_BLOCKS];
+//Inode table, the inode table itself and the root directory come first, the input files follow
+std::vector<MyFile *> root;
+DMap dMap;
 int fat[DATA_BLOCKS];
 unsigned int countBlocksNeed = 0;
-char frame[BLOCK_SIZE];
+unsigned int blockSize = BLOCK_SIZE;
+char *frame;
 int fd;
 unsigned int blockCount = 0;
+//Inode table blocks and directory blocks of the root directory, they start the data area
+unsigned int inodeTableBlocks = 0;
+unsigned int directoryBlocks = 0;
+char *metaFrames;
+unsigned long fileBlocks = 0;
+
+int parseOptions(int *argc, char **argv[]) {
+    //Check if a block size has been provided with '-b <block size>' in front of the container file.
+    if (*argc >= 3 && strcmp((*argv)[1], "-b") == 0) {
+        char *end;
+        unsigned long size = strtoul((*argv)[2], &end, 10);
+        if (*end != '\0' || size < BLOCK_SIZE || size > BLOCK_SIZE_MAX || (size & (size - 1)) != 0) {
+            cout << "Error(wrong block size): '" << (*argv)[2] << "' is not a valid block size. "
+                 << "Please provide a power of two between " << BLOCK_SIZE << " and " << BLOCK_SIZE_MAX << "."
+                 << endl;
+            return -1;
+        }
+        blockSize = (unsigned int) size;
+        (*argv)[2] = (*argv)[0];
+        *argv += 2;
+        *argc -= 2;
+    }
+    return 0;
+}
 
 void initializeObjects() {
-    blockDevice = new BlockDevice(BD_BLOCK_SIZE);
-    superBlock = new SuperBlock();
+    blockDevice = new BlockDevice(blockSize);
+    superBlock = new SuperBlock(blockSize);
+    frame = new char[blockSize];
     for (int i = 0; i < DATA_BLOCKS; i++) {
-        dMap[i] = 'e';
         fat[i] = -1;
     }
 }
 
 int inputChecks(int argc, char *argv[]) {
-    //Check if more then 64 files has been provided.
-    if (argc > 2 + NUM_DIR_ENTRIES) {
-        cout << "Error(to much files): You provided more then 64 files. " << endl;
-        return -1;
-    }
     //Check if argv contains the container file.
     if (argc < 2) {
         cout << "Error(no container file): No container file has been provided. " <<
@@ -69,22 +97,23 @@ int inputChecks(int argc, char *argv[]) {
 
     }
     //Check if there are any file duplicates.
+    std::set<std::string> fileNames;
     for (int i = 2; i < argc; i++) {
-        for (int n = i + 1; n < argc; n++) {
-            if (strncmp(basename(argv[i]), basename(argv[n]), strlen(argv[i])) == 0) {
-                cout << "Error(duplicate file name found): '" << argv[n] << "' and '" << argv[i]
-                     << "' would represent the same file in this file system." << endl;
-                return -1;
-            }
+        if (!fileNames.insert(basename(argv[i])).second) {
+            cout << "Error(duplicate file name found): '" << argv[i]
+                 << "' would represent the same file as another file in this file system." << endl;
+            return -1;
         }
     }
     //Check if all inserted files are accessible.
     for (int i = 2; i < argc; i++) {
-        if (open(argv[i], O_RDONLY) < 0) {
+        fd = open(argv[i], O_RDONLY);
+        if (fd < 0) {
             cout << "Error(cannot open file): '" << argv[i]
                  << "' is not accessible. Please provide this file in an accessible mode." << endl;
             return -1;
         }
+        close(fd);
     }
     //Check if the correct container file has been provided, asks for the correct container file or create a
     //container file if argv contains no container file.
@@ -101,9 +130,9 @@ int inputChecks(int argc, char *argv[]) {
             return -1;
         }
     }
-    //Checks if all files combined are not greater then 30,1 MB
-    ssize_t ret = 512;
-    int fileSizes = 0;
+    //Checks if all files combined are not greater then the file system size
+    ssize_t ret;
+    unsigned long fileSizes = 0;
     for (int j = 2; j < argc; j++) {
         fd = open(argv[j], O_RDONLY);
         if (fd < 0) {
@@ -111,117 +140,204 @@ int inputChecks(int argc, char *argv[]) {
                  << "' is not accessible. Please provide this file in an accessible mode." << endl;
             return -errno;
         }
-        while (ret == 512) {
-            ret = read(fd, frame, sizeof(frame));
-            fileSizes += ret;
+        unsigned long fileSize = 0;
+        while ((ret = read(fd, frame, blockSize)) > 0) {
+            fileSize += ret;
+        }
+        close(fd);
+        fileSizes += fileSize;
+        //A small file is stored in its inode and needs no data blocks
+        if (fileSize > INLINE_DATA_SIZE) {
+            fileBlocks += (fileSize + blockSize - 1) / blockSize;
         }
         if (ret < 0) {
             cout << "Error" << endl;
             return -errno;
-        } else if (ret < BLOCK_SIZE) {
-            close(fd);
-            ret = 512;
         }
     }
-    if (fileSizes > FILE_SYSTEM_MAX_DATA_SIZE_IN_MB) {
+    if (fileSizes > superBlock->getFileSystemSize()) {
         cout << "Error(file system size overflow): Your files are combined "
-             << fileSizes - FILE_SYSTEM_MAX_DATA_SIZE_IN_MB
-             << " Byte(s) greater then the maximum file system size of 30,1 MB."
-             << endl;
+             << fileSizes - superBlock->getFileSystemSize()
+             << " Byte(s) greater then the maximum file system size of " << superBlock->getFileSystemSize()
+             << " Byte(s)." << endl;
         return -1;
     }
     return 0;
 }
 
-void writeSuperBlockToContainer() {
-    memcpy(frame, (char *) superBlock, sizeof(SuperBlock));
-    blockDevice->write(0, frame);
+MyFile *createInode(unsigned int mode, int parentIndex) {
+    MyFile *file = new MyFile();
+    file->setFileSize(0);
+    file->setUserID(getuid());
+    file->setGroupID(getgid());
+    file->setMode(mode);
+    file->setATime(time(nullptr));
+    file->setMTime(time(nullptr));
+    file->setCTime(time(nullptr));
+    file->setFirstDataBlockIndex(-1);
+    file->setOpenIndex(-1);
+    file->setParentIndex(parentIndex);
+    file->clearExtents();
+    root.push_back(file);
+    return file;
 }
 
-void writeDMapAndFatToContainer() {
-    char *writeFrame = (char *) dMap;
-    for (int i = D_MAP_BLOCK_INDEX_START; i < FAT_BLOCK_INDEX_START; i++) {
-        blockDevice->write(i, writeFrame);
-        writeFrame += 512;
+void assignMetaDataBlocks(int rootIndex, unsigned int count) {
+    root[rootIndex]->setFirstDataBlockIndex(count > 0 ? blockCount : -1);
+    root[rootIndex]->setFileSize(count * blockSize);
+    root[rootIndex]->appendExtent(blockCount, count);
+    for (unsigned int k = 0; k < count; k++) {
+        dMap.setUsed(blockCount);
+        fat[blockCount] = k + 1 < count ? blockCount + 1 : -1;
+        blockCount++;
     }
-    writeFrame = (char *) fat;
-    for (unsigned int i = FAT_BLOCK_INDEX_START; i < ROOT_BLOCK_INDEX_START; i++) {
-        blockDevice->write(i, writeFrame);
-        writeFrame += 512;
+}
+
+int createInodeTableAndRootDirectory(int argc, char *argv[]) {
+    //Inodes of the inode table, the root directory and every input file
+    createInode(S_IFREG | 0400, -1);
+    createInode(S_IFDIR | 0755, ROOT_DIRECTORY);
+    unsigned int inodeCount = ROOT_DIRECTORY + 1 + (argc - 2);
+    unsigned int inodesPerBlock = blockSize / superBlock->getInodeSize();
+    inodeTableBlocks = (inodeCount + inodesPerBlock - 1) / inodesPerBlock;
+    //The root directory doubles its blocks until the entries of all input files fit into their hash buckets
+    std::vector<char> directory;
+    bool fits = false;
+    for (directoryBlocks = 1; !fits && directoryBlocks <= DIRECTORY_MAX_BUCKETS; directoryBlocks *= 2) {
+        directory.assign((size_t) directoryBlocks * blockSize, 0);
+        for (unsigned int j = 0; j < directoryBlocks; j++) {
+            DirectoryBlock(directory.data() + (size_t) j * blockSize, blockSize).clear();
+        }
+        fits = true;
+        for (int j = 2; j < argc && fits; j++) {
+            const char *fileName = basename(argv[j]);
+            size_t length = strlen(fileName);
+            unsigned int bucket = DirectoryBlock::hashName(fileName, length) & (directoryBlocks - 1);
+            fits = DirectoryBlock(directory.data() + (size_t) bucket * blockSize, blockSize).insert(
+                    fileName, length, ROOT_DIRECTORY + 1 + (j - 2));
+        }
+    }
+    directoryBlocks /= 2;
+    if (!fits || (unsigned long) inodeTableBlocks + directoryBlocks + fileBlocks > DATA_BLOCKS) {
+        cout << "Error(too many files): The inode table and the root directory of " << argc - 2
+             << " files do not fit into the file system with the content of the files." << endl;
+        return -1;
+    }
+    assignMetaDataBlocks(INODE_TABLE, inodeTableBlocks);
+    assignMetaDataBlocks(ROOT_DIRECTORY, directoryBlocks);
+    metaFrames = new char[(size_t) (inodeTableBlocks + directoryBlocks) * blockSize];
+    memset(metaFrames, 0, (size_t) inodeTableBlocks * blockSize);
+    memcpy(metaFrames + (size_t) inodeTableBlocks * blockSize, directory.data(), directory.size());
+    superBlock->setInodeTableBlock(root[INODE_TABLE]->getFirstDataBlockIndex());
+    superBlock->setInodeCount(inodeCount);
+    return 0;
+}
+
+void writeDataBlocks(unsigned int firstBlock, unsigned int count, char *buffer) {
+    //Blocks containing only zeros are not written, the container file keeps a hole there
+    for (unsigned int runStart = 0, runEnd; runStart < count; runStart = runEnd + 1) {
+        for (runEnd = runStart; runEnd < count; runEnd++) {
+            char *block = buffer + (size_t) runEnd * blockSize;
+            if (block[0] == 0 && memcmp(block, block + 1, blockSize - 1) == 0) {
+                break;
+            }
+        }
+        if (runEnd > runStart) {
+            blockDevice->writeBlocks(superBlock->getDataBlockIndexStart() + firstBlock + runStart, runEnd - runStart,
+                                     buffer + (size_t) runStart * blockSize);
+        }
     }
 }
 
-void writeRootToContainer(int argc) {
-    for (int i = 0, j = ROOT_BLOCK_INDEX_START; i < argc - 2; i++, j++) {
-        memcpy(frame, (char *) root[i], sizeof(MyFile));
-        blockDevice->write(j, frame);
+void writeMetaDataToContainer() {
+    //SuperBlock, DMap, Fat, the inode table and the root directory are written with one submission
+    BlockBatch batch(blockSize);
+    unsigned int inodesPerBlock = blockSize / superBlock->getInodeSize();
+    for (unsigned int i = 0; i < root.size(); i++) {
+        root[i]->encode(metaFrames + (size_t) (i / inodesPerBlock) * blockSize +
+                        (i % inodesPerBlock) * superBlock->getInodeSize());
     }
+    memset(frame, 0, blockSize);
+    superBlock->encode(frame);
+    batch.queueWrite(SUPER_BLOCK_BLOCK_INDEX_START, SUPER_BLOCK_BLOCKS, frame);
+    batch.queueWrite(superBlock->getDMapBlockIndexStart(), superBlock->getDMapBlocks(), dMap.getData());
+    batch.queueWrite(superBlock->getFatBlockIndexStart(), superBlock->getFatBlocks(), (char *) fat);
+    batch.queueWrite(superBlock->getDataBlockIndexStart() + superBlock->getInodeTableBlock(),
+                     inodeTableBlocks + directoryBlocks, metaFrames);
+    blockDevice->submit(&batch);
+    delete[] metaFrames;
 }
 
 int writeFilesToContainer(int argc, char *argv[]) {
-    ssize_t ret = BLOCK_SIZE;
-    int emptyFileDetected = 1;
-    for (int i = 0, j = 2; j < argc; i++, j++) {
-        root[i] = new MyFile();
+    ssize_t ret;
+    unsigned int fileSize;
+    size_t copySize = COPY_BLOCKS * blockSize;
+    char *copyFrame = new char[copySize];
+    unsigned long usedSize = (unsigned long) (inodeTableBlocks + directoryBlocks) * blockSize;
+    for (int i = ROOT_DIRECTORY + 1, j = 2; j < argc; i++, j++) {
+        createInode(S_IFREG | 0444, ROOT_DIRECTORY);
         root[i]->setFirstDataBlockIndex(blockCount);
-        root[i]->setOpenIndex(-1);
         fd = open(argv[j], O_RDONLY);
         if (fd < 0) {
             cout << "Error opening file " << argv[j] << endl;
+            delete[] copyFrame;
             return -errno;
         }
-        while (ret == BLOCK_SIZE) {
-            ret = read(fd, frame, BLOCK_SIZE);
-            if (ret < 0) {
-                cout << "Error reading from file " << argv[j] << endl;
-                return -errno;
-            } else if (ret != 0) {
-                blockDevice->write(DATA_BLOCKS_INDEX_START + blockCount, frame);
-                dMap[blockCount] = 'f';
+        //Copying the file in runs of COPY_BLOCKS blocks, all blocks of a file are stored contiguously. A file which
+        //is read completely with its first run and fits into INLINE_DATA_SIZE is stored in its inode.
+        fileSize = 0;
+        while ((ret = read(fd, copyFrame, copySize)) > 0) {
+            if (fileSize == 0 && ret <= INLINE_DATA_SIZE && (size_t) ret < copySize) {
+                root[i]->setInlineData(copyFrame, ret);
+                fileSize = ret;
+                break;
+            }
+            unsigned int runBlocks = (ret + blockSize - 1) / blockSize;
+            memset(copyFrame + ret, 0, runBlocks * blockSize - ret);
+            writeDataBlocks(blockCount, runBlocks, copyFrame);
+            root[i]->appendExtent(blockCount, runBlocks);
+            for (unsigned int k = 0; k < runBlocks; k++) {
+                dMap.setUsed(blockCount);
                 fat[blockCount] = blockCount + 1;
                 blockCount++;
                 countBlocksNeed++;
-                emptyFileDetected = 0;
             }
-
-            if (ret < BLOCK_SIZE || ret == 0) {
-                cout << "File " << j - 1 << "(" << argv[j]
-                     << "): File end reached. File saved on container.bin. CountBlockNeeded: " << countBlocksNeed
-                     << endl;
-                close(fd);
+            fileSize += ret;
+            if ((size_t) ret < copySize) {
+                break;
             }
         }
-        if (blockCount > 0) {
-            fat[blockCount - 1] = -1;
+        if (ret < 0) {
+            cout << "Error reading from file " << argv[j] << endl;
+            close(fd);
+            delete[] copyFrame;
+            return -errno;
         }
+        cout << "File " << j - 1 << "(" << argv[j]
+             << "): File end reached. File saved on container.bin. CountBlockNeeded: " << countBlocksNeed
+             << endl;
+        close(fd);
         //Fill root information.
-        root[i]->setFileName(basename(argv[j]));
-        if (emptyFileDetected == 1) {
+        if (fileSize == 0 || root[i]->hasInlineData()) {
             root[i]->setFirstDataBlockIndex(-1);
-            root[i]->setFileSize(0);
-            emptyFileDetected = 0;
-        } else if (ret == 0) {
-            root[i]->setFileSize((countBlocksNeed) * BLOCK_SIZE);
         } else {
-            root[i]->setFileSize(((countBlocksNeed - 1) * BLOCK_SIZE) + ret);
+            fat[blockCount - 1] = -1;
         }
-        root[i]->setUserID(getuid());
-        root[i]->setGroupID(getgid());
-        root[i]->setMode(S_IFREG | 0444);
+        root[i]->setFileSize(fileSize);
+        usedSize += fileSize;
         struct stat stat1{};
         stat(argv[j], &stat1);
         root[i]->setATime(stat1.st_atim.tv_sec);
         root[i]->setMTime(stat1.st_mtim.tv_sec);
         root[i]->setCTime(stat1.st_ctim.tv_sec);
-        ret = 512;
         countBlocksNeed = 0;
         superBlock->addFile();
     }
-    writeSuperBlockToContainer();
-    writeDMapAndFatToContainer();
-    writeRootToContainer(argc);
+    delete[] copyFrame;
+    superBlock->setUsedSize(usedSize);
+    writeMetaDataToContainer();
     blockDevice->read(SUPER_BLOCK_BLOCK_INDEX_START, frame);
-    memcpy((char *) superBlock, frame, sizeof(SuperBlock));
+    superBlock->decode(frame);
     blockDevice->close();
     return 0;
 }
@@ -229,11 +345,17 @@ int writeFilesToContainer(int argc, char *argv[]) {
 void printSuperBlockInfo(int print, SuperBlock *sBlock) {
     if (print == 1) {
         cout << endl << "SuperBlock: " << endl <<
+             "FormatVersion: " << sBlock->getFormatVersion() << endl <<
              "SuperBlockIndexStart: " << sBlock->getSuperBlockIndexStart() << endl <<
              "FileSystemSize: " << sBlock->getFileSystemSize() << endl <<
              "DMApBlockStart: " << sBlock->getDMapBlockIndexStart() << endl <<
              "FATBlockStart: " << sBlock->getFatBlockIndexStart() << endl <<
-             "RootBlockStart: " << sBlock->getRootBlockIndexStart() << endl <<
+             "JournalBlockStart: " << sBlock->getJournalBlockIndexStart() << endl <<
+             "JournalBlocks: " << sBlock->getJournalBlocks() << endl <<
+             "DataBlockStart: " << sBlock->getDataBlockIndexStart() << endl <<
+             "BlockSize: " << sBlock->getBlockSize() << endl <<
+             "InodeTableBlock: " << sBlock->getInodeTableBlock() << endl <<
+             "InodeCount: " << sBlock->getInodeCount() << endl <<
              "FileCount: " << sBlock->getFileCount() << endl << endl;
     }
 }
@@ -241,18 +363,18 @@ void printSuperBlockInfo(int print, SuperBlock *sBlock) {
 void printDMapAndFat(int print) {
     if (print == 1) {
         for (unsigned int i = 0; i < 65536; i++) {
-            cout << "Index: " << i << ", DMap-Value: " << dMap[i] << " Fat-Value: " << fat[i] << endl;
+            cout << "Index: " << i << ", DMap-Value: " << (dMap.isUsed(i) ? 'f' : 'e') << " Fat-Value: " << fat[i] << endl;
         }
     }
 }
 
-void printRootFileInfos(int print, int argc) {
+void printRootFileInfos(int print, char *argv[]) {
     int dataBlocks = 0;
     if (print == 1) {
-        for (int i = 0; i < argc - 2; i++) {
+        for (unsigned int i = ROOT_DIRECTORY + 1; i < root.size(); i++) {
             cout << "Root " << i << ": " << endl;
             cout <<
-                 "Filename: " << root[i]->getFileName() << endl <<
+                 "Filename: " << basename(argv[i - ROOT_DIRECTORY + 1]) << endl <<
                  "FileSize: " << root[i]->getFileSize() << endl <<
                  "UserID: " << root[i]->getUserID() << endl <<
                  "GroupID: " << root[i]->getGroupID() << endl <<
@@ -261,15 +383,15 @@ void printRootFileInfos(int print, int argc) {
                  "MTime: " << root[i]->getMTime() << endl <<
                  "CTime: " << root[i]->getCTime() << endl <<
                  "FirstDataBlockIndex: " << root[i]->getFirstDataBlockIndex() << endl;
-            if (root[i]->getFileSize() % 512 != 0) {
-                dataBlocks = ((int) (root[i]->getFileSize() / 512) + 1);
+            if (root[i]->getFileSize() % blockSize != 0) {
+                dataBlocks = ((int) (root[i]->getFileSize() / blockSize) + 1);
             } else {
-                dataBlocks = ((int) (root[i]->getFileSize() / 512));
+                dataBlocks = ((int) (root[i]->getFileSize() / blockSize));
             }
             cout << "LastDataBlockIndex: " << (dataBlocks + root[i]->getFirstDataBlockIndex()) << endl <<
                  "UsedDataBlocks: " << dataBlocks << endl <<
                  "FreeDataBlocks: "
-                 << ((FILE_SYSTEM_MAX_DATA_SIZE_IN_MiB / 512) - (dataBlocks + root[i]->getFirstDataBlockIndex()))
+                 << (DATA_BLOCKS - (dataBlocks + root[i]->getFirstDataBlockIndex()))
                  << endl << endl;
 
         }
@@ -277,13 +399,16 @@ void printRootFileInfos(int print, int argc) {
 }
 
 int main(int argc, char *argv[]) {
+    if (parseOptions(&argc, &argv) < 0) {
+        return -1;
+    }
     initializeObjects();
-    if (inputChecks(argc, argv) < 0) {
+    if (inputChecks(argc, argv) < 0 || createInodeTableAndRootDirectory(argc, argv) < 0) {
         return -1;
     }
     int writeFilesRet = writeFilesToContainer(argc, argv);
     printSuperBlockInfo(1, superBlock);
     printDMapAndFat(0);
-    printRootFileInfos(1, argc);
+    printRootFileInfos(1, argv);
     return writeFilesRet;
 }
\ No newline at end of file
@@ -29,7 +29,9 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <algorithm>
 #include <cerrno>
+#include <sys/uio.h>
 #include <iostream>
 
 #include "macros.h"
@@ -39,14 +41,141 @@
 
 using namespace std;
 
-SuperBlock::SuperBlock() {}
+SuperBlock::SuperBlock(unsigned int blockSize) {
+    this->blockSize = blockSize;
+    this->fileSystemSize = (long unsigned int) FILE_SYSTEM_MAX_DATA_SIZE_IN_MB * (blockSize / BLOCK_SIZE);
+    this->superBlockBlockIndexStart = SUPER_BLOCK_BLOCK_INDEX_START;
+    this->dMapBlockIndexStart = SUPER_BLOCK_BLOCK_INDEX_START + SUPER_BLOCK_BLOCKS;
+    this->fatBlockIndexStart = this->dMapBlockIndexStart + (D_MAP_BYTES + blockSize - 1) / blockSize;
+    //The journal lies behind the fat blocks, it has room for two transactions of the maximum size
+    this->journalBlockIndexStart = this->fatBlockIndexStart + (FAT_SIZE + blockSize - 1) / blockSize;
+    unsigned int transactionBlocks = getJournalTransactionBlocks();
+    transactionBlocks += Journal::getDescriptorBlocks(blockSize, transactionBlocks);
+    unsigned int journalBlocks = std::max(JOURNAL_SIZE / blockSize, 2 * transactionBlocks);
+    this->journalSequence = 1;
+    this->dataBlockIndexStart = this->journalBlockIndexStart + journalBlocks;
+    //The inode table is created by mkfs.myfs
+    this->inodeTableBlock = -1;
+    this->inodeCount = 0;
+    this->freeInode = -1;
+    this->usedSize = 0;
+    this->inodeSize = INODE_SIZE;
+    this->formatVersion = FORMAT_VERSION;
+}
 
 SuperBlock::~SuperBlock() {}
 
+void SuperBlock::encode(char *frame) {
+    memset(frame, 0, BLOCK_SIZE);
+    char *position = encodeUInt32(frame, FORMAT_MAGIC);
+    position = encodeUInt32(position, FORMAT_VERSION);
+    position = encodeUInt64(position, this->fileSystemSize);
+    position = encodeUInt32(position, this->superBlockBlockIndexStart);
+    position = encodeUInt32(position, this->dMapBlockIndexStart);
+    position = encodeUInt32(position, this->fatBlockIndexStart);
+    position = encodeUInt32(position, this->journalBlockIndexStart);
+    position = encodeUInt32(position, this->fileCount);
+    position = encodeUInt32(position, this->blockSize);
+    position = encodeUInt32(position, this->dataBlockIndexStart);
+    position = encodeUInt64(position, this->journalSequence);
+    position = encodeInt32(position, this->inodeTableBlock);
+    position = encodeUInt32(position, this->inodeCount);
+    position = encodeInt32(position, this->freeInode);
+    position = encodeUInt64(position, this->usedSize);
+    encodeUInt32(position, this->inodeSize);
+}
+
+int SuperBlock::decode(const char *frame) {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t field;
+    const char *position = decodeUInt32(frame, &magic);
+    position = decodeUInt32(position, &version);
+    if (magic != FORMAT_MAGIC || version == 0 || version > FORMAT_VERSION) {
+        return -EINVAL;
+    }
+    this->formatVersion = version;
+    position = decodeUInt64(position, &field);
+    this->fileSystemSize = field;
+    position = decodeUInt32(position, &this->superBlockBlockIndexStart);
+    position = decodeUInt32(position, &this->dMapBlockIndexStart);
+    position = decodeUInt32(position, &this->fatBlockIndexStart);
+    position = decodeUInt32(position, &this->journalBlockIndexStart);
+    position = decodeUInt32(position, &this->fileCount);
+    position = decodeUInt32(position, &this->blockSize);
+    position = decodeUInt32(position, &this->dataBlockIndexStart);
+    position = decodeUInt64(position, &this->journalSequence);
+    position = decodeInt32(position, &this->inodeTableBlock);
+    position = decodeUInt32(position, &this->inodeCount);
+    position = decodeInt32(position, &this->freeInode);
+    position = decodeUInt64(position, &field);
+    this->usedSize = field;
+    decodeUInt32(position, &this->inodeSize);
+    return 0;
+}
+
 MyFile::MyFile() {}
 
 MyFile::~MyFile() {}
 
+void MyFile::encode(char *record) {
+    char *position = encodeUInt64(record, this->fileSize);
+    position = encodeUInt32(position, this->userID);
+    position = encodeUInt32(position, this->groupID);
+    position = encodeUInt32(position, this->mode);
+    position = encodeInt32(position, this->parentIndex);
+    position = encodeInt64(position, this->aTime);
+    position = encodeInt64(position, this->mTime);
+    position = encodeInt64(position, this->cTime);
+    position = encodeInt32(position, this->firstDataBlock);
+    position = encodeUInt32(position, this->extentCount);
+    if (hasInlineData()) {
+        memcpy(position, this->inlineData, INLINE_DATA_SIZE);
+        position += INLINE_DATA_SIZE;
+    } else {
+        for (unsigned int e = 0; e < FILE_EXTENTS; e++) {
+            position = encodeUInt32(position, this->extents[e].fileBlock);
+            position = encodeInt32(position, this->extents[e].dataBlock);
+            position = encodeUInt32(position, this->extents[e].length);
+        }
+    }
+    encodeUInt32(position, this->flags);
+}
+
+void MyFile::decode(const char *record, unsigned int formatVersion) {
+    uint64_t size;
+    int64_t time;
+    const char *position = decodeUInt64(record, &size);
+    this->fileSize = (unsigned int) size;
+    position = decodeUInt32(position, &this->userID);
+    position = decodeUInt32(position, &this->groupID);
+    position = decodeUInt32(position, &this->mode);
+    position = decodeInt32(position, &this->parentIndex);
+    position = decodeInt64(position, &time);
+    this->aTime = (time_t) time;
+    position = decodeInt64(position, &time);
+    this->mTime = (time_t) time;
+    position = decodeInt64(position, &time);
+    this->cTime = (time_t) time;
+    position = decodeInt32(position, &this->firstDataBlock);
+    position = decodeUInt32(position, &this->extentCount);
+    //The flags follow the extents, they tell whether the extents hold inline data
+    this->flags = 0;
+    if (formatVersion >= 2) {
+        decodeUInt32(position + INLINE_DATA_SIZE, &this->flags);
+    }
+    if (hasInlineData()) {
+        memcpy(this->inlineData, position, INLINE_DATA_SIZE);
+    } else {
+        for (unsigned int e = 0; e < FILE_EXTENTS; e++) {
+            position = decodeUInt32(position, &this->extents[e].fileBlock);
+            position = decodeInt32(position, &this->extents[e].dataBlock);
+            position = decodeUInt32(position, &this->extents[e].length);
+        }
+    }
+    this->openIndex = -1;
+}
+
 MyFS *MyFS::_instance = NULL;
 
 MyFS *MyFS::Instance() {
@@ -58,8 +187,16 @@ MyFS *MyFS::Instance() {
 
 MyFS::MyFS() {
     this->logFile = stderr;
-    blockDevice = new BlockDevice(BD_BLOCK_SIZE);
+    if (RAM_CONTAINER) {
+        blockDevice = new RamBlockDevice(BD_BLOCK_SIZE);
+    } else {
+        blockDevice = new BlockDevice(BD_BLOCK_SIZE);
+    }
+    blockCache = NULL;
     superBlock = new SuperBlock();
+    blockSize = superBlock->getBlockSize();
+    dataBlocksIndexStart = superBlock->getDataBlockIndexStart();
+    inodesPerBlock = blockSize / superBlock->getInodeSize();
 }
 
 MyFS::~MyFS() {}
@@ -74,7 +211,6 @@ MyFS::~MyFS() {}
 int MyFS::fuseGetattr(const char *path, struct stat *statBuf) {
     LogM();
     // TODO: fuseGetattr
-    char *file = clearPath(path);
     //LogF("\tAttributes of %s requested\n", path);
 
     // GNU's definitions of the attributes (http://www.gnu.org/software/libc/manual/html_node/Attribute-Meanings.html):
@@ -92,23 +228,17 @@ int MyFS::fuseGetattr(const char *path, struct stat *statBuf) {
         statBuf->st_mode = S_IFDIR | 0555;
         statBuf->st_nlink = 2; // Why "two" hardlinks instead of "one"? The answer is here: http://unix.stackexchange.com/a/101536
     } else {
-        unsigned int found = 0;
-        for (unsigned int i = 0; i < NUM_DIR_ENTRIES; i++) {
-            if (strcmp(file, root[i]->getFileName()) == 0 && hasRootIndexAFile[i] == 1) {
-                found++;
-                statBuf->st_mode = root[i]->getMode();
-                statBuf->st_nlink = 1;
-                statBuf->st_size = root[i]->getFileSize();
-                statBuf->st_atime = root[i]->getATime();
-                statBuf->st_mtime = root[i]->getMTime();
-                statBuf->st_ctime = root[i]->getCTime();
-            }
-        }
-        if (found < 1) {
-            RETURN(-ENOENT)
+        int fileIndex = findFile(path);
+        if (fileIndex < 0) {
+            RETURN(fileIndex)
         }
+        statBuf->st_mode = root[fileIndex]->getMode();
+        statBuf->st_nlink = S_ISDIR(root[fileIndex]->getMode()) ? 2 : 1;
+        statBuf->st_size = root[fileIndex]->getFileSize();
+        statBuf->st_atime = root[fileIndex]->getATime();
+        statBuf->st_mtime = root[fileIndex]->getMTime();
+        statBuf->st_ctime = root[fileIndex]->getCTime();
     }
-    free(file);
     RETURN(0)
 }
 
@@ -122,36 +252,8 @@ int MyFS::fuseGetattr(const char *path, struct stat *statBuf) {
 int MyFS::fuseMkNod(const char *path, mode_t mode, dev_t dev) {
     // TODO: fuseMkNod
     LogM();
-    int returnValue = 0;
-    char *clearedPath = clearPath(path);
-    LogF("Path %s", clearedPath);
-    //Error detection
-    if (superBlock->getFileCount() >= NUM_DIR_ENTRIES ||
-        this->currentFileSystemSize >= FILE_SYSTEM_MAX_DATA_SIZE_IN_MB) {
-        returnValue = -ENOSPC;
-    } else if (checkFileIfNotUsed(clearedPath) == -1) {
-        returnValue = -EEXIST;
-    }
-    //Creating and initializing a new file
-    if (returnValue >= 0) {
-        auto *file = new MyFile();
-        file->setOpenIndex(-1);
-        file->setFirstDataBlockIndex(-1);
-        file->setFileName(clearedPath);
-        file->setFileSize(0);
-        file->setUserID(getuid());
-        file->setGroupID(getgid());
-        file->setMode(mode);
-        file->setATime(time(nullptr));
-        file->setMTime(time(nullptr));
-        file->setCTime(time(nullptr));
-
-        int fileIndex = findFreeRootIndex();
-        root[fileIndex] = file;
-        hasRootIndexAFile[fileIndex] = 1;
-        superBlock->addFile();
-    }
-    free(clearedPath);
+    LogF("Path %s", path);
+    int returnValue = createFile(path, mode);
     RETURN(returnValue)
 }
 
@@ -163,47 +265,10 @@ int MyFS::fuseMkNod(const char *path, mode_t mode, dev_t dev) {
 int MyFS::fuseUnlink(const char *path) {
     // TODO: fuseUnlink
     LogM();
-    int returnValue = 0;
-    char *clearedPath = clearPath(path);
-    int fileIndex = -1;
-    MyFile *file;
-    int firstDataBlock;
-    int saveLastBlock;
-    for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
-        if (strcmp(root[i]->getFileName(), clearedPath) == 0) {
-            fileIndex = i;
-            break;
-        }
-    }
-    if (fileIndex < 0) {
-        returnValue = -ENOENT;
-    } else {
-        file = root[fileIndex];
-        firstDataBlock = file->getFirstDataBlockIndex();
-        while (firstDataBlock != -1) {
-            saveLastBlock = firstDataBlock;
-            firstDataBlock = fat[firstDataBlock];
-            fat[saveLastBlock] = -1;
-            dMap[saveLastBlock] = 'e';
-        }
-        hasRootIndexAFile[fileIndex] = 0;
-        LogF("Path: %s", clearedPath);
-        LogF("File index: %d", fileIndex);
-        LogF("First data block index: %d", firstDataBlock);
-        LogF("Opened file index  %d", file->getOpenIndex());
-        LogF("Current file system size: %lu", currentFileSystemSize);
-        LogF("Open files:  %hu", this->openFiles);
-        if (file->getOpenIndex() >= 0) {
-            openFilesArray[fileIndex] = -1;
-            this->openFiles--;
-        }
-        currentFileSystemSize -= file->getFileSize();
-        LogF("Open files now: %hu", openFiles);
-        LogF("File size  %d", file->getFileSize());
-        LogF("New current file system size: %lu", currentFileSystemSize);
-        LogF("File count old: %d", superBlock->getFileCount());
-        superBlock->removeFile();
-        LogF("File count new: %d", superBlock->getFileCount());
+    int returnValue = findFile(path);
+    if (returnValue >= 0) {
+        returnValue = S_ISDIR(root[returnValue]->getMode()) ? -EISDIR :
+                      removeFile(returnValue, strrchr(path, '/') + 1);
     }
     logDMapAndFatInfos(0);
     RETURN(returnValue)
@@ -219,37 +284,33 @@ int MyFS::fuseOpen(const char *path, struct fuse_file_info *fileInfo) {
     // TODO: fuseOpen
     LogM();
     int returnValue = 0;
-    int fileFound = 0;
-    char *clearedPath;
     //File handle -1 as standard for error case
     fileInfo->fh = -1;
-    clearedPath = clearPath(path);
+    int i = findFile(path);
     if (this->openFiles > NUM_OPEN_FILES) {
         returnValue = -EMFILE;
+    } else if (i < 0) {
+        returnValue = i;
+    } else if (S_ISDIR(root[i]->getMode())) {
+        returnValue = -EISDIR;
+    } else if ((getuid() == root[i]->getUserID() ||
+                getgid() == root[i]->getGroupID()) && root[i]->getOpenIndex() == -1) {
+        //Setting file handle for an existing file which has been opened (Opened=0)
+        fileInfo->fh = i;
+        root[i]->setOpenIndex(openFiles);
+        ReadAhead *state = &readAhead[i];
+        state->nextOffset = 0;
+        state->window = 0;
+        state->prefetchedUntil = 0;
+        updateBlockIndex(i);
+        LogF("File handle:  %d", i);
+        LogF("File open index:  %d", openFiles);
+        this->openFiles++;
+        LogF("Open files now: %hu", openFiles);
+        LogF("File %s has been opened.", path);
+    } else {
+        returnValue = -EACCES;
     }
-    //Setting file handle for an existing file which has been opened (Opened=0)
-    for (uint16_t i = 0; i < NUM_DIR_ENTRIES && returnValue >= 0; i++) {
-        if (strcmp(root[i]->getFileName(), clearedPath) == 0) {
-            if ((getuid() == root[i]->getUserID() ||
-                 getgid() == root[i]->getGroupID()) && root[i]->getOpenIndex() == -1) {
-                fileInfo->fh = i;
-                root[i]->setOpenIndex(openFiles);
-                LogF("File handle:  %hu", i);
-                LogF("File open index:  %d", openFiles);
-                this->openFiles++;
-                LogF("Open files now: %hu", openFiles);
-                fileFound++;
-            } else {
-                returnValue = -EACCES;
-            }
-            break;
-        }
-    }
-    if (fileFound == 0) {
-        returnValue = -ENOENT;
-    }
-    LogF("File %s has been opened.", clearedPath);
-    free(clearedPath);
     RETURN(returnValue)
 }
 
@@ -267,88 +328,95 @@ int MyFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struc
     LogM();
     int returnValue = 1;
     int rootIndex = fileInfo->fh;
-    int countDataBlocksInvolved = 0;
-    unsigned int firstDataBlockRest = 0;
-    unsigned int lastDataBlockRest = 0;
-    unsigned int copySize = 512;
-    unsigned int countBytes = 0;
-    char *clearedPath = clearPath(path);
-    char *writeFrame = new char[512];
-    char *frameCopy = writeFrame;
-    char *bufCopy = buf;
-    MyFile *file;
+    MyFile *file = NULL;
     LogF("Root index: %d", rootIndex);
-    file = root[rootIndex];
-    int firstDataBlock = file->getFirstDataBlockIndex();
-    LogF("First data block index: %d", firstDataBlock);
-    LogF("File size: %d", file->getFileSize());
-    LogF("Path: %s", clearedPath);
+    LogF("Path: %s", path);
     LogF("Size: %zu", size);
     LogF("Offset: %ld", offset);
 
     //Error detection
-    if (rootIndex > NUM_DIR_ENTRIES - 1 || rootIndex < 0) {
+    if (rootIndex < 0 || (unsigned int) rootIndex >= root.size() || root[rootIndex] == NULL) {
         returnValue = -EBADF;
-    } else if (size == 0 || file->getFileSize() == 0) {
-        returnValue = 0;
-    } else if (file->getFileSize() == 0 || file->getFileSize() < offset || offset < 0) {
-        returnValue = -ENXIO;
+    } else {
+        file = root[rootIndex];
+        LogF("First data block index: %d", file->getFirstDataBlockIndex());
+        LogF("File size: %d", file->getFileSize());
+        if (size == 0 || file->getFileSize() == 0) {
+            returnValue = 0;
+        } else if (file->getFileSize() < offset || offset < 0) {
+            returnValue = -ENXIO;
+        } else if (file->getFileSize() == offset) {
+            returnValue = 0;
+        }
     }
     if (returnValue > 0) {
-        //Finding the data block for the requested content
-        for (unsigned int k = 0; k < (offset / BLOCK_SIZE) && fat[firstDataBlock] != -1; k++) {
-            firstDataBlock = fat[firstDataBlock];
-        }
-        //Calculation the first rest, involved data blocks and the last rest, they will be used for copying the content
-        firstDataBlockRest = (offset % BLOCK_SIZE);
-        countDataBlocksInvolved = size / BLOCK_SIZE;
-        lastDataBlockRest = (offset + size - firstDataBlockRest) % BLOCK_SIZE;
-        if (file->getFileSize() < BLOCK_SIZE) {
-            countDataBlocksInvolved = 1;
-            lastDataBlockRest = BLOCK_SIZE - file->getFileSize();
-        }
-        LogF("First data block rest: %d", firstDataBlockRest);
-        LogF("countDataBlocksInvolved: %d", countDataBlocksInvolved);
-        LogF("Last data block rest: %d", lastDataBlockRest);
-
-        //Copying the requested content into buf
-        for (int i = firstDataBlock, j = 0; countBytes < file->getFileSize() && i != -1 && j < countDataBlocksInvolved;
-             i = fat[i], j++) {
-            //Using cached last read block or loading a new one
-            if (i == lastBlockRead) {
-                memcpy(frameCopy, lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), BLOCK_SIZE);
-            } else {
-                blockDevice->read(DATA_BLOCKS_INDEX_START + i, frameCopy);
-            }
-            //Changing the copySize if necessary because of not proportional requested offSet and or size
-            if (i == firstDataBlock) {
-                frameCopy += (offset % BLOCK_SIZE);
-                copySize = BLOCK_SIZE - (offset % BLOCK_SIZE);
+        //Requested content behind the end of the file is not returned
+        if (offset + size > file->getFileSize()) {
+            size = file->getFileSize() - offset;
+        }
+        //Buffered content of the file is written before it is read
+        std::unordered_map<int, DelayedWrite>::iterator pending = delayedWrites.find(rootIndex);
+        if (pending != delayedWrites.end() && offset + size > (size_t) pending->second.start) {
+            returnValue = commitDelayedWrite(rootIndex);
+            if (returnValue == 0) {
+                returnValue = 1;
             }
-            if (file->getFileSize() - offset < copySize) {
-                copySize = file->getFileSize() - offset;
+        }
+    }
+    if (returnValue > 0 && file->hasInlineData()) {
+        //The content of a small file comes with its inode, no data block is read
+        memcpy(buf, file->getInlineData() + offset, size);
+        updateATime(rootIndex);
+        returnValue = size;
+    } else if (returnValue > 0) {
+        unsigned int firstBlockNumber = offset / blockSize;
+        unsigned int count = (offset + size - 1) / blockSize - firstBlockNumber + 1;
+        int *blocks = new int[count];
+        char **buffers = new char *[count];
+        char *headFrame = new char[blockSize];
+        char *tailFrame = new char[blockSize];
+        LogF("First block number: %d", firstBlockNumber);
+        LogF("Count data blocks involved: %d", count);
+
+        //Finding the data blocks for the requested content
+        unsigned int j = getDataBlocks(rootIndex, firstBlockNumber, count, blocks);
+        if (j < count) {
+            returnValue = -EIO;
+        } else if (copyMappedDataBlocks(blocks, count, offset, buf, size, false)) {
+            returnValue = 0;
+            buffers[0] = NULL;
+        } else {
+            //Full blocks are read directly into buf, only a partial first and last block are staged
+            for (j = 0; j < count; j++) {
+                off_t blockStart = (off_t) (firstBlockNumber + j) * blockSize;
+                if (blockStart >= offset && blockStart + blockSize <= (off_t) (offset + size)) {
+                    buffers[j] = buf + (blockStart - offset);
+                } else {
+                    buffers[j] = (j == 0) ? headFrame : tailFrame;
+                }
             }
-            if (size - countBytes < copySize) {
-                copySize = size - countBytes;
+            returnValue = transferDataBlocks(blocks, buffers, count, false);
+        }
+        if (returnValue >= 0) {
+            //Copying the requested part of the staged blocks into buf
+            for (j = 0; j < count && buffers[0] != NULL; j++) {
+                if (buffers[j] == headFrame || buffers[j] == tailFrame) {
+                    off_t blockStart = (off_t) (firstBlockNumber + j) * blockSize;
+                    off_t from = offset > blockStart ? offset : blockStart;
+                    off_t to = (off_t) (offset + size) < blockStart + blockSize ? (off_t) (offset + size) :
+                               blockStart + blockSize;
+                    memcpy(buf + (from - offset), buffers[j] + (from - blockStart), to - from);
+                }
             }
-            memcpy(bufCopy, frameCopy, copySize);
-            bufCopy += copySize;
-            countBytes += copySize;
-            frameCopy = writeFrame;
-            lastBlockRead = i;
-            copySize = 512;
-        }
-        //Caching last read data block
-        memcpy(lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-        if (offset + size > file->getFileSize()) {
-            errno = ENXIO;
+            updateATime(rootIndex);
+            readAheadAfter(rootIndex, offset, size);
+            returnValue = size;
         }
-        file->setATime(time(nullptr));
-        free(writeFrame);
-        free(clearedPath);
-        returnValue = countBytes;
+        delete[] blocks;
+        delete[] buffers;
+        delete[] headFrame;
+        delete[] tailFrame;
     }
-    LogF("lastBlockRead %d", lastBlockRead);
     RETURN(returnValue)
 }
 
@@ -363,292 +431,141 @@ int MyFS::fuseRead(const char *path, char *buf, size_t size, off_t offset, struc
  */
 int MyFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fileInfo) {
     // TODO: fuseWrite
+    LogM();
     int returnValue = 1;
     int rootIndex = fileInfo->fh;
-    char *clearedPath = clearPath(path);
-    int firstDataBlock;
-    int countMoreBytesNeeded = 0;
-    int saveFirstDataBlock = -1;
-    unsigned int lastWrittenDataBlock = 0;
-    unsigned int copySize = BLOCK_SIZE;
-    unsigned int countBytes = 0;
-    char *writeFrame = new char[BLOCK_SIZE];
-    char *frameCopy = writeFrame;
-    char *bufCopy = new char[size];
-    MyFile *file = root[rootIndex];
-
-    //Error detection
-    if (rootIndex > NUM_DIR_ENTRIES - 1 || rootIndex < 0) {
-        returnValue = -EBADF;
-    } else if (size == 0) {
-        returnValue = 0;
-    } else if (currentFileSystemSize >= superBlock->getFileSystemSize()) {
-        returnValue = -ENOSPC;
-    } else if (offset > file->getFileSize()) {
-        returnValue = -ENXIO;
-    }
-    firstDataBlock = file->getFirstDataBlockIndex();
-    //Beginning logs
-    LogM();
-    LogF("Path %s", clearedPath);
+    MyFile *file = NULL;
+    LogF("Path %s", path);
     LogF("Size: %zu", size);
     LogF("Offset: %ld", offset);
     LogF("RootIndex: %d", rootIndex);
-    LogF("File size: %d", file->getFileSize());
-    LogF("First data block: %d", firstDataBlock);
     LogF("Current file system size: %lu", currentFileSystemSize);
     LogF("File system size: %lu", superBlock->getFileSystemSize());
 
-    //Enter only if returnValue greater then 0
+    //Error detection
+    if (rootIndex < 0 || (unsigned int) rootIndex >= root.size() || root[rootIndex] == NULL) {
+        returnValue = -EBADF;
+    } else {
+        file = root[rootIndex];
+        LogF("File size: %d", file->getFileSize());
+        LogF("First data block: %d", file->getFirstDataBlockIndex());
+        if (size == 0) {
+            returnValue = 0;
+        } else if (offset > file->getFileSize() || offset < 0) {
+            returnValue = -ENXIO;
+        } else if (offset + size > file->getFileSize() &&
+                   currentFileSystemSize >= superBlock->getFileSystemSize()) {
+            returnValue = -ENOSPC;
+        }
+    }
     if (returnValue > 0) {
-        //Copy the provided content into the copy array
-        memcpy(bufCopy, buf, size);
-        //Case if file is empty and has no dataBlock
-        if (file->getFileSize() == 0 && firstDataBlock == -1) {
-            //Offset must be 0
-            if (offset != 0) {
-                returnValue = -ENXIO;
-            } else {
-                firstDataBlock = assignFreeDataBlock();
-                LogF("First data block: %d", firstDataBlock);
-                file->setFirstDataBlockIndex(firstDataBlock);
-
-                for (int j = 0; size > countBytes && currentFileSystemSize < superBlock->getFileSystemSize() &&
-                                firstDataBlock != -1; j++) {
-                    //Changing copySize if 512 Byte are to much
-                    if (size - countBytes < BLOCK_SIZE) {
-                        copySize = size - countBytes;
-                    }
-                    //Changing copySize if file system has less then 512 byte left
-                    if (BLOCK_SIZE + currentFileSystemSize > superBlock->getFileSystemSize()) {
-                        copySize = superBlock->getFileSystemSize() - currentFileSystemSize;
-                    }
-                    //Copy content into frameCopy for saving it onto the block device
-                    memcpy(frameCopy, bufCopy, copySize);
-                    currentFileSystemSize += copySize;
-                    bufCopy += copySize;
-                    countBytes += copySize;
-                    frameCopy = writeFrame;
-                    //Caching the last written block
-                    lastBlockWritten = firstDataBlock;
-                    lastBlockRead = lastBlockWritten;
-                    memcpy(lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                    memcpy(lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                    //write content onto block device
-                    blockDevice->write(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                    //Resetting copySize to 512
-                    copySize = BLOCK_SIZE;
-                    //assign new data block and updating next data block of old last data block
-                    lastWrittenDataBlock = firstDataBlock;
-                    firstDataBlock = assignFreeDataBlock();
-                    fat[lastWrittenDataBlock] = firstDataBlock;
-                    //Set errno if no space left signaled with freeDataBlockIndex is -1
-                    if (firstDataBlock == -1) {
-                        errno = -ENOSPC;
-                    }
+        unsigned int oldFileSize = file->getFileSize();
+        //Limiting the content to the space left in the file system
+        if (offset + size > oldFileSize &&
+            currentFileSystemSize + (offset + size - oldFileSize) > superBlock->getFileSystemSize()) {
+            size -= currentFileSystemSize + (offset + size - oldFileSize) - superBlock->getFileSystemSize();
+        }
+        size_t writeSize = size;
+        //A small file keeps its content in its inode, it moves into a data block when it outgrows
+        //INLINE_DATA_SIZE
+        if ((file->hasInlineData() || (oldFileSize == 0 && delayedWrites.count(rootIndex) == 0)) &&
+            offset + size <= INLINE_DATA_SIZE) {
+            char content[INLINE_DATA_SIZE];
+            memcpy(content, file->getInlineData(), oldFileSize);
+            memcpy(content + offset, buf, size);
+            file->setInlineData(content, offset + size > oldFileSize ? offset + size : oldFileSize);
+            size = 0;
+        } else if (file->hasInlineData()) {
+            char content[INLINE_DATA_SIZE];
+            memcpy(content, file->getInlineData(), oldFileSize);
+            file->clearInlineData();
+            if (oldFileSize > 0) {
+                returnValue = bufferDelayedWrite(rootIndex, content, 0, oldFileSize);
+                if (returnValue >= 0) {
+                    returnValue = commitDelayedWrite(rootIndex);
                 }
-                //Updating meta information of the file
-                file->setFileSize(countBytes);
-                // reset last assigned data block if no new data block was needed if the
-                // written bytes has been proportional to 2^n
-                if (returnValue % BLOCK_SIZE == 0) {
-                    dMap[fat[lastWrittenDataBlock]] = 'e';
-                    fat[lastWrittenDataBlock] = -1;
+                if (returnValue == 0) {
+                    returnValue = 1;
                 }
             }
-            //Case if content of a file should be added to the end
-        } else if (offset == file->getFileSize()) {
-            //Getting the last data block
-            for (unsigned int k = 0; k < (offset / BLOCK_SIZE) && firstDataBlock >= 0; k++) {
-                saveFirstDataBlock = firstDataBlock;
-                firstDataBlock = fat[firstDataBlock];
-            }
-            LogF("firstDataBlock: %d", firstDataBlock);
-
-            // Case if the old file size was proportional to 2^n
-            if (firstDataBlock == -1) {
-                firstDataBlock = assignFreeDataBlock();
-                //Case if no new data block is left
-                if (firstDataBlock == -1) {
-                    returnValue = -ENOSPC;
-                } else {
-                    //updating next data block of old last data block
-                    fat[saveFirstDataBlock] = firstDataBlock;
-                    for (int j = 0; size > countBytes && currentFileSystemSize < superBlock->getFileSystemSize() &&
-                                    firstDataBlock != -1; j++) {
-                        //not necessary because the offset is proportional to 2^n
-                        if (j == 0) {
-                            frameCopy += offset % BLOCK_SIZE;
-                            copySize = BLOCK_SIZE - (offset % BLOCK_SIZE);
-                        }
-                        //Changing copySize if less then 512 are needed
-                        if (size - countBytes < BLOCK_SIZE) {
-                            copySize = size - countBytes;
-                        }
-                        //Changing copySize if file system has less then 512 byte left
-                        if (copySize + currentFileSystemSize > superBlock->getFileSystemSize()) {
-                            copySize = superBlock->getFileSystemSize() - currentFileSystemSize;
-                            errno = -ENOSPC;
-                        }
-                        //Copy content into frameCopy for saving it onto the block device
-                        memcpy(frameCopy, bufCopy, copySize);
-                        currentFileSystemSize += copySize;
-                        bufCopy += copySize;
-                        countBytes += copySize;
-                        frameCopy = writeFrame;
-                        //Caching the last written block
-                        lastBlockWritten = saveFirstDataBlock;
-                        lastBlockRead = lastBlockWritten;
-                        memcpy(lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                        memcpy(lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                        //write content onto block device
-                        blockDevice->write(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                        //Resetting copySize to 512
-                        copySize = 512;
-                        //assign new data block and updating next data block of old last data block
-                        lastWrittenDataBlock = firstDataBlock;
-                        firstDataBlock = assignFreeDataBlock();
-                        fat[lastWrittenDataBlock] = firstDataBlock;
-                        if (firstDataBlock == -1) {
-                            errno = -ENOSPC;
-                        }
-                    }
-                    //Updating meta information of the file
-                    file->setFileSize(file->getFileSize() + countBytes);
-                }
-            } else {
-                for (int j = 0; size > countBytes && currentFileSystemSize < superBlock->getFileSystemSize() &&
-                                firstDataBlock != -1; j++) {
-                    //Get cached content or load it from the block device
-                    if (firstDataBlock == lastBlockWritten) {
-                        memcpy(frameCopy, lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), BLOCK_SIZE);
-                    } else {
-                        blockDevice->read(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                    }
-                    //Changing copySize if 512 Byte are to much
-                    if (j == 0) {
-                        frameCopy += (offset % BLOCK_SIZE);
-                        copySize = BLOCK_SIZE - (offset % BLOCK_SIZE);
-                    }
-                    //Changing copySize if less then 512 are needed
-                    if (copySize > size - countBytes) {
-                        copySize = size - countBytes;
-                    }
-                    //Changing copySize if file system has less then 512 byte left
-                    if (currentFileSystemSize + copySize > superBlock->getFileSystemSize()) {
-                        copySize = superBlock->getFileSystemSize() - currentFileSystemSize;
-                    }
-                    //Copy content into frameCopy for saving it onto the block device
-                    memcpy(frameCopy, bufCopy, copySize);
-                    currentFileSystemSize += copySize;
-                    bufCopy += copySize;
-                    countBytes += copySize;
-                    frameCopy = writeFrame;
-                    //Caching the last written block
-                    lastBlockWritten = firstDataBlock;
-                    lastBlockRead = lastBlockWritten;
-                    memcpy(lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                    memcpy(lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                    //write content onto block device
-                    blockDevice->write(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                    //Resetting copySize to 512
-                    copySize = 512;
-                    //assign new data block and updating next data block of old last data block
-                    lastWrittenDataBlock = firstDataBlock;
-                    firstDataBlock = assignFreeDataBlock();
-                    fat[lastWrittenDataBlock] = firstDataBlock;
-                    if (firstDataBlock == -1) {
-                        errno = -ENOSPC;
-                    }
-                }
-                //Updating meta information of the file
-                file->setFileSize(file->getFileSize() + countBytes);
-                // reset last assigned data block if no new data block was needed if the
-                // written bytes has been proportional to 2^n
-                if (returnValue % BLOCK_SIZE == 0) {
-                    dMap[fat[lastWrittenDataBlock]] = 'e';
-                    fat[lastWrittenDataBlock] = -1;
-                }
+            LogF("Inline data of %u bytes moved into a data block: %d", oldFileSize, returnValue);
+        }
+        //Content behind the data blocks of the file is buffered, its blocks are assigned later (delayed allocation)
+        std::unordered_map<int, DelayedWrite>::iterator pending = delayedWrites.find(rootIndex);
+        off_t chainEnd = pending != delayedWrites.end() ? pending->second.start :
+                         ((off_t) oldFileSize + blockSize - 1) / blockSize * blockSize;
+        if (returnValue > 0 && (off_t) (offset + size) > chainEnd) {
+            off_t from = offset > chainEnd ? offset : chainEnd;
+            returnValue = bufferDelayedWrite(rootIndex, buf + (from - offset), from, offset + size - from);
+            size = from - offset;
+            if (returnValue == 0) {
+                returnValue = 1;
             }
-        } else if (offset < file->getFileSize()) {
-            for (unsigned int k = 0; k < (offset / BLOCK_SIZE) && firstDataBlock >= 0; k++) {
-                firstDataBlock = fat[firstDataBlock];
+        }
+        //Content inside the data blocks of the file is written through the block cache, content behind them has
+        //been buffered above, so all data blocks exist
+        if (returnValue > 0 && size > 0) {
+            unsigned int firstBlockNumber = offset / blockSize;
+            unsigned int count = (offset + size - 1) / blockSize - firstBlockNumber + 1;
+            int *blocks = new int[count];
+            char **buffers = new char *[count];
+            char *headFrame = new char[blockSize];
+            char *tailFrame = new char[blockSize];
+
+            //Collecting the data blocks of the file
+            if (getDataBlocks(rootIndex, firstBlockNumber, count, blocks) < count) {
+                returnValue = -EIO;
             }
-            LogF("firstDataBlock: %d", firstDataBlock);
-
-            for (int j = 0; size > countBytes && currentFileSystemSize < superBlock->getFileSystemSize() &&
-                            firstDataBlock != -1; j++) {
-                if (firstDataBlock == lastBlockWritten) {
-                    memcpy(frameCopy, lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), BLOCK_SIZE);
-                } else {
-                    blockDevice->read(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                }
-                //Changing copySize if 512 Byte are to much
-                if (j == 0) {
-                    frameCopy += (offset % BLOCK_SIZE);
-                    copySize = BLOCK_SIZE - (offset % BLOCK_SIZE);
-                }
-                //Changing copySize if less then 512 are needed
-                if (copySize > size - countBytes) {
-                    copySize = size - countBytes;
-                }
-                //Changing copySize if file system has less then 512 byte left
-                if (currentFileSystemSize + copySize > superBlock->getFileSystemSize()) {
-                    copySize = superBlock->getFileSystemSize() - currentFileSystemSize;
-                }
-                //Copy content into frameCopy for saving it onto the block device
-                memcpy(frameCopy, bufCopy, copySize);
-                currentFileSystemSize += copySize;
-                bufCopy += copySize;
-                countBytes += copySize;
-                frameCopy = writeFrame;
-                //Caching the last written block
-                lastBlockWritten = firstDataBlock;
-                lastBlockRead = lastBlockWritten;
-                memcpy(lastBlockReadFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                memcpy(lastBlockWritenFrame + (BLOCK_SIZE * file->getOpenIndex()), frameCopy, BLOCK_SIZE);
-                //write content onto block device
-                blockDevice->write(DATA_BLOCKS_INDEX_START + firstDataBlock, frameCopy);
-                //Resetting copySize to 512
-                copySize = BLOCK_SIZE;
-                //Adding a data block if there are additional bytes added at the end of the file
-                lastWrittenDataBlock = firstDataBlock;
-                if (fat[firstDataBlock] == -1) {
-                    firstDataBlock = assignFreeDataBlock();
-                    if (size - countBytes < BLOCK_SIZE) {
-                        countMoreBytesNeeded += size - countBytes;
+            if (returnValue > 0 && copyMappedDataBlocks(blocks, count, offset, (char *) buf, size, true)) {
+                returnValue = 0;
+            } else if (returnValue > 0) {
+                //Full blocks are written directly from buf, a partial first and last block are merged with their
+                //content
+                for (unsigned int j = 0; j < count && returnValue > 0; j++) {
+                    off_t blockStart = (off_t) (firstBlockNumber + j) * blockSize;
+                    if (blockStart >= offset && blockStart + blockSize <= (off_t) (offset + size)) {
+                        buffers[j] = (char *) buf + (blockStart - offset);
                     } else {
-                        countMoreBytesNeeded += BLOCK_SIZE;
+                        buffers[j] = (j == 0) ? headFrame : tailFrame;
+                        if (blockStart < oldFileSize) {
+                            returnValue = blockCache->read(dataBlocksIndexStart + blocks[j], buffers[j]);
+                            if (returnValue == 0) {
+                                returnValue = 1;
+                            }
+                        } else {
+                            memset(buffers[j], 0, blockSize);
+                        }
+                        off_t from = offset > blockStart ? offset : blockStart;
+                        off_t to = (off_t) (offset + size) < blockStart + blockSize ? (off_t) (offset + size) :
+                                   blockStart + blockSize;
+                        memcpy(buffers[j] + (from - blockStart), buf + (from - offset), to - from);
                     }
                 }
-                //updating next data block of old last data block
-                fat[lastWrittenDataBlock] = firstDataBlock;
-                if (firstDataBlock == -1) {
-                    errno = -ENOSPC;
+                if (returnValue > 0) {
+                    returnValue = transferDataBlocks(blocks, buffers, count, true);
                 }
             }
+            delete[] blocks;
+            delete[] buffers;
+            delete[] headFrame;
+            delete[] tailFrame;
+        }
+        if (returnValue >= 0) {
             //Updating meta information of the file
-            file->setFileSize(file->getFileSize() + countMoreBytesNeeded);
-            // reset last assigned data block if no new data block was needed if the
-            // written bytes has been proportional to 2^n
-            if (returnValue % BLOCK_SIZE == 0) {
-                dMap[fat[lastWrittenDataBlock]] = 'e';
-                fat[lastWrittenDataBlock] = -1;
+            if (offset + writeSize > oldFileSize) {
+                file->setFileSize(offset + writeSize);
+                currentFileSystemSize += offset + writeSize - oldFileSize;
             }
+            file->setATime(time(nullptr));
+            file->setMTime(time(nullptr));
+            markRootDirty(rootIndex);
+            writeBackMetaDataIfDue();
+            returnValue = writeSize;
         }
-        //Updating meta information of the file
         LogF("File size at the end of writing: %d", file->getFileSize());
-        LogF("CountBytes: %d", countBytes);
-        file->setATime(time(nullptr));
-        file->setMTime(time(nullptr));
-        if (returnValue > 0) {
-            returnValue = countBytes;
-        }
     }
     //Information logging after writing
     LogF("Current file system size after writing: %lu", currentFileSystemSize);
-    LogF("last block read: %d", lastWrittenDataBlock);
-    free(writeFrame);
     RETURN(returnValue)
 }
 
@@ -661,10 +578,14 @@ int MyFS::fuseWrite(const char *path, const char *buf, size_t size, off_t offset
 int MyFS::fuseRelease(const char *path, struct fuse_file_info *fileInfo) {
     // TODO: fuseRelease
     LogM();
-    if (fileInfo->fh >= 0) {
+    if (fileInfo->fh < root.size() && root[fileInfo->fh] != NULL) {
+        int returnValue = commitDelayedWrite(fileInfo->fh);
         root[fileInfo->fh]->clearOpenIndex();
+        readAhead.erase(fileInfo->fh);
+        updateBlockIndex(fileInfo->fh);
+        writeBackMetaDataIfDue();
         this->openFiles--;
-        RETURN(0)
+        RETURN(returnValue)
     } else {
         RETURN(-ENOENT)
     }
@@ -688,93 +609,474 @@ MyFS::fuseReaddir(const char *path, void *buf, fuse_fill_dir_t filler, off_t off
     filler(buf, ".", NULL, 0);
     // Parent Directory
     filler(buf, "..", NULL, 0);
-    // If the user is trying to show the files/directories of the root directory show the following
-    if (strcmp(path, "/") == 0) {
-        for (unsigned int i = 0; i < NUM_DIR_ENTRIES; i++) {
-            if (hasRootIndexAFile[i] == 1 && filler(buf, root[i]->getFileName(), NULL, 0) == 1) {
+    //The root directory is an ordinary directory without a name
+    int dirIndex = strcmp(path, "/") == 0 ? ROOT_DIRECTORY : findFile(path);
+    if (dirIndex < 0) {
+        RETURN(dirIndex)
+    }
+    if (!S_ISDIR(root[dirIndex]->getMode())) {
+        RETURN(-ENOTDIR)
+    }
+    //All directory blocks are read with one request
+    unsigned int buckets = getDataBlockCount(dirIndex);
+    std::vector<int> blocks(buckets);
+    std::vector<char> data((size_t) buckets * blockSize);
+    std::vector<char *> buffers(buckets);
+    for (unsigned int j = 0; j < buckets; j++) {
+        buffers[j] = data.data() + (size_t) j * blockSize;
+    }
+    int ret = readDirectoryBlocks(dirIndex, 0, buckets, blocks.data(), buffers.data());
+    if (ret < 0) {
+        RETURN(ret)
+    }
+    for (unsigned int j = 0; j < buckets; j++) {
+        DirectoryBlock directoryBlock(buffers[j], blockSize);
+        unsigned int offset = 0;
+        int entryIndex;
+        const char *name;
+        size_t length;
+        //The names are listed from the directory blocks, the inodes are not loaded
+        while (directoryBlock.next(&offset, &entryIndex, &name, &length)) {
+            char fileName[FILE_NAME_MAX_LENGTH + 1];
+            memcpy(fileName, name, length);
+            fileName[length] = '\0';
+            if (filler(buf, fileName, NULL, 0) == 1) {
                 LogF("buffer is full, size of buffer: %ld", sizeof(buf));
             }
         }
-    } else {
-        RETURN(-ENOTDIR)
     }
     RETURN(0)
 }
 
 /**
- * This method is called at the beginning for initializing the file system.
+ * This method is called at the beginning for initializing the file system. If the container cannot be read the
+ * FUSE loop is exited, so the mount fails instead of serving operations without meta data.
  * @param conn
+ * @return private data of the mount
  */
 void *MyFS::fuseInit(struct fuse_conn_info *conn) {
     // TODO: fuseInit
+    MyFsInfo *info = (MyFsInfo *) fuse_get_context()->private_data;
+    int ret = mountContainer(info->contFile, info->logFile);
+    //Without its meta data no operation can run, the mount fails
+    if (ret < 0) {
+        fprintf(stderr, "ERROR: Cannot mount container file %s: %s\n", info->contFile, strerror(-ret));
+        fuse_exit(fuse_get_context()->fuse);
+    }
+    return info;
+}
+
+
+// Our file systems own additional methods:
+int MyFS::mountContainer(const char *containerFile, const char *logFileName) {
     int ret;
-    char *copy;
-    char frame[512];
+    char *frame;
     // Open logfile
-    this->logFile = fopen(((MyFsInfo *) fuse_get_context()->private_data)->logFile, "w+");
+    this->logFile = fopen(logFileName, "w+");
     if (this->logFile == NULL) {
-        fprintf(stderr, "ERROR: Cannot open logfile %s\n",
-                ((MyFsInfo *) fuse_get_context()->private_data)->logFile);
+        ret = -errno;
+        fprintf(stderr, "ERROR: Cannot open logfile %s\n", logFileName);
     } else {
-        //this->logFile= reinterpret_cast<FILE *>(((MyFsInfo *) fuse_get_context()->private_data)->logFile);
         // turn of logfile buffering
         setvbuf(this->logFile, NULL, _IOLBF, 0);
         LogM();
         LOG("Starting logging...\n");
-        // you can get the contain file name here:
-        LogF("Container file name: %s", ((MyFsInfo *) fuse_get_context()->private_data)->contFile);
+        LogF("Container file name: %s", containerFile);
 
-        ret = blockDevice->open(((MyFsInfo *) fuse_get_context()->private_data)->contFile);
+        ret = blockDevice->open(containerFile, DIRECT_IO_CONTAINER ? BD_DIRECT_IO : 0);
         LogF("Return wert of opening container file: %d", ret);
+        if (ret >= 0 && MAP_CONTAINER && !blockDevice->isDirect()) {
+            ret = blockDevice->map();
+            LogF("Return wert of mapping container file: %d", ret);
+        }
         if (ret >= 0) {
-            //Initializing superBlock
-            copy = (char *) superBlock;
-            blockDevice->read(0, frame);
-            memcpy(copy, frame, sizeof(SuperBlock));
-            //Initializing DMap
-            copy = dMap;
-            for (unsigned int i = D_MAP_BLOCK_INDEX_START; i < FAT_BLOCK_INDEX_START; i++, copy += BLOCK_SIZE) {
-                blockDevice->read(i, copy);
+            //Initializing superBlock, it contains the block size and the position of all other blocks
+            frame = new char[BLOCK_SIZE];
+            ret = blockDevice->read(SUPER_BLOCK_BLOCK_INDEX_START, frame);
+            if (ret >= 0) {
+                ret = superBlock->decode(frame);
+                LogF("Format version: %u, return wert of decoding the superBlock: %d", superBlock->getFormatVersion(),
+                     ret);
             }
-            //Initializing Fat
-            copy = (char *) fat;
-            for (int i = FAT_BLOCK_INDEX_START; i < ROOT_BLOCK_INDEX_START; i++, copy += BLOCK_SIZE) {
-                blockDevice->read(i, copy);
+            delete[] frame;
+            blockSize = superBlock->getBlockSize();
+            dataBlocksIndexStart = superBlock->getDataBlockIndexStart();
+            LogF("Block size: %u", blockSize);
+            if (ret >= 0 && (blockSize < BLOCK_SIZE || blockSize > BLOCK_SIZE_MAX || (blockSize & (blockSize - 1)) ||
+                             superBlock->getInodeSize() < INODE_RECORD_SIZE ||
+                             superBlock->getInodeSize() > blockSize)) {
+                LOG("ERROR: invalid block size or inode size in superBlock");
+                ret = -EINVAL;
             }
-            //Initializing Root
-            for (unsigned int i = 0; i < NUM_DIR_ENTRIES; i++) {
-                blockDevice->read(ROOT_BLOCK_INDEX_START + i, frame);
-                root[i] = new MyFile();
-                memcpy(root[i], (MyFile *) frame, sizeof(MyFile));
+            if (ret >= 0) {
+                inodesPerBlock = blockSize / superBlock->getInodeSize();
             }
-            //Initializing OpenFile array, currentFileSystemSize and hasRootIndexAFile array
-            for (unsigned int j = 0; j < NUM_DIR_ENTRIES; j++) {
-                openFilesArray[j] = -1;
-                currentFileSystemSize += root[j]->getFileSize();
-                if (j < superBlock->getFileCount()) {
-                    hasRootIndexAFile[j] = 1;
-                } else {
-                    hasRootIndexAFile[j] = 0;
-                }
+        }
+        if (ret >= 0) {
+            blockDevice->resize(blockSize);
+            if (superBlock->getJournalBlocks() > 0) {
+                ret = replayJournal();
             }
+        }
+        if (ret >= 0) {
+            blockCache = new BlockCache(blockDevice, blockSize, BLOCK_CACHE_SIZE);
+            //Only the DMap is read through the block cache now, the free extents are built from it. Fat blocks
+            //and inodes are read on first use, so the blocks read by a mount do not grow with the container.
+            unsigned int dMapBlocks = superBlock->getDMapBlocks();
+            uint64_t *blocks = new uint64_t[dMapBlocks];
+            char **buffers = new char *[dMapBlocks];
+            for (unsigned int i = 0; i < dMapBlocks; i++) {
+                blocks[i] = superBlock->getDMapBlockIndexStart() + i;
+                buffers[i] = dMap.getData() + i * blockSize;
+            }
+            ret = blockCache->readBlocks(blocks, buffers, dMapBlocks);
+            LogF("Return wert of reading the DMap: %d", ret);
+            dirtyMetaBlocks.assign(dMapBlocks + superBlock->getFatBlocks(), false);
+            loadedFatBlocks.assign(superBlock->getFatBlocks(), false);
+            metaDataWrittenBack = time(nullptr);
+            delete[] blocks;
+            delete[] buffers;
+            dMap.load();
+            freeExtents.load(&dMap);
+            LogF("Free data blocks: %u in %u extents", freeExtents.getFreeCount(), freeExtents.getExtentCount());
+            //Inodes are loaded on demand, only the inode table and the root directory are loaded now
+            root.assign(superBlock->getInodeCount(), NULL);
+            dirtyInodes.clear();
+            dentryCache.clear();
+            directoryFrame = new char[blockSize];
+            if (ret >= 0) {
+                ret = loadFile(INODE_TABLE);
+            }
+            if (ret >= 0) {
+                updateBlockIndex(INODE_TABLE);
+                ret = loadFile(ROOT_DIRECTORY);
+            }
+            LogF("Inodes: %u, return wert of loading the root directory: %d", superBlock->getInodeCount(), ret);
+            currentFileSystemSize = superBlock->getUsedSize();
             LogF("currentFileSystemSize: %lu", currentFileSystemSize);
             logSuperBlockInfos(0);
             logDMapAndFatInfos(0);
             logRootInfos(0);
         }
     }
-    RETURN(0)
+    if (ret < 0) {
+        delete blockCache;
+        blockCache = NULL;
+        delete journal;
+        journal = NULL;
+    }
+    return ret;
+}
+
+int MyFS::findFile(const char *path) {
+    int dirIndex;
+    const char *name;
+    int fileIndex;
+    int ret = resolvePath(path, &dirIndex, &name);
+    if (ret >= 0) {
+        ret = findEntry(dirIndex, name, strlen(name), &fileIndex);
+    }
+    return ret < 0 ? ret : fileIndex;
+}
+
+int MyFS::resolvePath(const char *path, int *dirIndex, const char **name) {
+    if (path[0] != '/') {
+        return -ENOENT;
+    }
+    const char *lastSlash = strrchr(path, '/');
+    *name = lastSlash + 1;
+    if (strlen(*name) > FILE_NAME_MAX_LENGTH) {
+        return -ENAMETOOLONG;
+    }
+    return findDirectory(path, lastSlash - path, dirIndex);
+}
+
+int MyFS::findDirectory(const char *path, size_t length, int *dirIndex) {
+    int ret = 0;
+    *dirIndex = ROOT_DIRECTORY;
+    for (size_t start = 1, end; start <= length && ret >= 0; start = end + 1) {
+        const char *slash = (const char *) memchr(path + start, '/', length - start);
+        end = slash != NULL ? (size_t) (slash - path) : length;
+        const char *name = path + start;
+        size_t nameLength = end - start;
+        //Repeated lookups of a component are answered by the dentry cache, the key is built from the path in place
+        uint64_t key = getDentryKey(*dirIndex, name, nameLength);
+        std::unordered_map<uint64_t, Dentry>::iterator cached = dentryCache.find(key);
+        if (cached != dentryCache.end() && cached->second.name.size() == nameLength &&
+            memcmp(cached->second.name.data(), name, nameLength) == 0) {
+            *dirIndex = cached->second.dirIndex;
+            continue;
+        }
+        ret = findEntry(*dirIndex, name, nameLength, dirIndex);
+        if (ret >= 0 && !S_ISDIR(root[*dirIndex]->getMode())) {
+            ret = -ENOTDIR;
+        }
+        if (ret >= 0) {
+            if (dentryCache.size() >= DENTRY_CACHE_SIZE) {
+                dentryCache.clear();
+            }
+            Dentry *dentry = &dentryCache[key];
+            dentry->name.assign(name, nameLength);
+            dentry->dirIndex = *dirIndex;
+        }
+    }
+    return ret;
 }
 
+uint64_t MyFS::getDentryKey(int parentIndex, const char *name, size_t length) {
+    return (uint64_t) (uint32_t) parentIndex << 32 | DirectoryBlock::hashName(name, length);
+}
 
-// Our file systems own additional methods:
-char *MyFS::clearPath(const char *path) {
-    char *subString = new char[strlen(path)];
-    for (unsigned int i = 0; i < strlen(subString) + 1; i++) {
-        subString[i] = path[i + 1];
+int MyFS::findEntry(int dirIndex, const char *name, size_t length, int *rootIndex) {
+    unsigned int buckets = getDataBlockCount(dirIndex);
+    if (buckets == 0) {
+        return -ENOENT;
+    }
+    //The directory block is read into the lookup buffer, a lookup allocates nothing
+    int block;
+    int ret = readDirectoryBlocks(dirIndex, DirectoryBlock::hashName(name, length) & (buckets - 1), 1, &block,
+                                  &directoryFrame);
+    if (ret >= 0) {
+        *rootIndex = DirectoryBlock(directoryFrame, blockSize).find(name, length);
+        ret = *rootIndex < 0 ? -ENOENT : loadFile(*rootIndex);
+    }
+    return ret;
+}
+
+int MyFS::addEntry(int dirIndex, const char *name, int rootIndex) {
+    size_t length = strlen(name);
+    uint32_t hash = DirectoryBlock::hashName(name, length);
+    unsigned int buckets = getDataBlockCount(dirIndex);
+    int ret = 0;
+    if (buckets == 0) {
+        ret = resizeDirectory(dirIndex, 1);
+        buckets = 1;
+    }
+    char *buffer = new char[blockSize];
+    while (ret >= 0) {
+        int block;
+        ret = readDirectoryBlocks(dirIndex, hash & (buckets - 1), 1, &block, &buffer);
+        if (ret < 0) {
+            break;
+        }
+        if (DirectoryBlock(buffer, blockSize).insert(name, length, rootIndex)) {
+            writeDirectoryBlock(block, buffer);
+            break;
+        }
+        //The directory block is full, the number of directory blocks is doubled
+        ret = buckets < DIRECTORY_MAX_BUCKETS ? resizeDirectory(dirIndex, buckets * 2) : -ENOSPC;
+        buckets *= 2;
+    }
+    delete[] buffer;
+    if (ret >= 0) {
+        root[dirIndex]->setMTime(time(nullptr));
+        markRootDirty(dirIndex);
+    }
+    return ret;
+}
+
+int MyFS::removeEntry(int dirIndex, const char *name) {
+    size_t length = strlen(name);
+    unsigned int buckets = getDataBlockCount(dirIndex);
+    if (buckets == 0) {
+        return -ENOENT;
+    }
+    int block;
+    char *buffer = new char[blockSize];
+    int ret = readDirectoryBlocks(dirIndex, DirectoryBlock::hashName(name, length) & (buckets - 1), 1, &block,
+                                  &buffer);
+    if (ret >= 0 && DirectoryBlock(buffer, blockSize).remove(name, length)) {
+        writeDirectoryBlock(block, buffer);
+    } else if (ret >= 0) {
+        ret = -ENOENT;
+    }
+    delete[] buffer;
+    if (ret >= 0) {
+        root[dirIndex]->setMTime(time(nullptr));
+        markRootDirty(dirIndex);
+    }
+    return ret;
+}
+
+int MyFS::resizeDirectory(int dirIndex, unsigned int buckets) {
+    unsigned int oldBuckets = getDataBlockCount(dirIndex);
+    std::vector<int> oldBlocks(oldBuckets);
+    std::vector<int> blocks(buckets);
+    std::vector<char> oldData((size_t) oldBuckets * blockSize);
+    std::vector<char> data((size_t) buckets * blockSize);
+    std::vector<char *> buffers(buckets);
+    for (unsigned int j = 0; j < oldBuckets; j++) {
+        buffers[j] = oldData.data() + (size_t) j * blockSize;
+    }
+    int ret = readDirectoryBlocks(dirIndex, 0, oldBuckets, oldBlocks.data(), buffers.data());
+    if (ret >= 0) {
+        ret = assignFreeDataBlocks(blocks.data(), buckets, getAppendGoal(dirIndex));
+    }
+    if (ret < 0) {
+        return ret;
+    }
+    //Distributing the entries by the next bit of their hash, they fit as every block gets part of one old block
+    for (unsigned int j = 0; j < buckets; j++) {
+        buffers[j] = data.data() + (size_t) j * blockSize;
+        DirectoryBlock(buffers[j], blockSize).clear();
+    }
+    for (unsigned int j = 0; j < oldBuckets; j++) {
+        DirectoryBlock oldBlock(oldData.data() + (size_t) j * blockSize, blockSize);
+        unsigned int offset = 0;
+        int entryIndex;
+        const char *name;
+        size_t length;
+        while (oldBlock.next(&offset, &entryIndex, &name, &length)) {
+            unsigned int bucket = DirectoryBlock::hashName(name, length) & (buckets - 1);
+            DirectoryBlock(buffers[bucket], blockSize).insert(name, length, entryIndex);
+        }
+    }
+    //No committed inode refers to the new blocks, so they are written in place. The next commit flushes them
+    //before the directory is switched to them, the old blocks stay intact until then.
+    ret = transferDataBlocks(blocks.data(), buffers.data(), buckets, true);
+    if (ret < 0) {
+        releaseDataBlocks(blocks.data(), buckets);
+        return ret;
+    }
+    unflushedDirectoryBlocks = true;
+    root[dirIndex]->setFirstDataBlockIndex(-1);
+    root[dirIndex]->clearExtents();
+    blockIndex.erase(dirIndex);
+    releaseDirectoryBlocks(oldBlocks.data(), oldBuckets);
+    appendDataBlocks(dirIndex, blocks.data(), buckets);
+    currentFileSystemSize += (size_t) (buckets - oldBuckets) * blockSize;
+    root[dirIndex]->setFileSize(buckets * blockSize);
+    markRootDirty(dirIndex);
+    LogF("Directory %d resized to %u blocks: %d", dirIndex, buckets, ret);
+    return ret;
+}
+
+int MyFS::getEntryCount(int dirIndex, unsigned int *count) {
+    unsigned int buckets = getDataBlockCount(dirIndex);
+    std::vector<int> blocks(buckets);
+    std::vector<char> data((size_t) buckets * blockSize);
+    std::vector<char *> buffers(buckets);
+    for (unsigned int j = 0; j < buckets; j++) {
+        buffers[j] = data.data() + (size_t) j * blockSize;
+    }
+    int ret = readDirectoryBlocks(dirIndex, 0, buckets, blocks.data(), buffers.data());
+    *count = 0;
+    for (unsigned int j = 0; j < buckets && ret >= 0; j++) {
+        *count += DirectoryBlock(buffers[j], blockSize).getCount();
+    }
+    return ret;
+}
+
+int MyFS::readDirectoryBlocks(int dirIndex, unsigned int firstBucket, unsigned int count, int *blocks,
+                              char **buffers) {
+    if (count == 0) {
+        return 0;
+    }
+    if (getDataBlocks(dirIndex, firstBucket, count, blocks) != count) {
+        return -EIO;
+    }
+    int ret = count == 1 ? blockCache->read(dataBlocksIndexStart + blocks[0], buffers[0]) :
+              transferDataBlocks(blocks, buffers, count, false);
+    for (unsigned int j = 0; j < count && ret >= 0 && !dirtyDirectoryBlocks.empty(); j++) {
+        std::unordered_map<int, char *>::iterator image = dirtyDirectoryBlocks.find(blocks[j]);
+        if (image != dirtyDirectoryBlocks.end()) {
+            memcpy(buffers[j], image->second, blockSize);
+        }
+    }
+    return ret;
+}
+
+void MyFS::writeDirectoryBlock(int block, const char *buffer) {
+    char *&image = dirtyDirectoryBlocks[block];
+    if (image == NULL) {
+        image = new char[blockSize];
+    }
+    memcpy(image, buffer, blockSize);
+    metaDataDirty = true;
+}
+
+int MyFS::createFile(const char *path, mode_t mode) {
+    int dirIndex;
+    const char *fileName;
+    int fileIndex;
+    int returnValue = resolvePath(path, &dirIndex, &fileName);
+    //Error detection
+    if (returnValue >= 0 && this->currentFileSystemSize >= superBlock->getFileSystemSize()) {
+        returnValue = -ENOSPC;
+    } else if (returnValue >= 0 && fileName[0] == '\0') {
+        returnValue = -EEXIST;
+    } else if (returnValue >= 0) {
+        returnValue = findEntry(dirIndex, fileName, strlen(fileName), &fileIndex);
+        returnValue = returnValue == -ENOENT ? 0 : returnValue < 0 ? returnValue : -EEXIST;
+    }
+    //Creating and initializing a new file
+    if (returnValue >= 0) {
+        returnValue = allocateRootIndex(&fileIndex);
+    }
+    if (returnValue >= 0) {
+        auto *file = new MyFile();
+        file->setOpenIndex(-1);
+        file->setFirstDataBlockIndex(-1);
+        file->clearExtents();
+        file->setParentIndex(dirIndex);
+        file->setFileSize(0);
+        file->setUserID(getuid());
+        file->setGroupID(getgid());
+        file->setMode(mode);
+        file->setATime(time(nullptr));
+        file->setMTime(time(nullptr));
+        file->setCTime(time(nullptr));
+
+        delete root[fileIndex];
+        root[fileIndex] = file;
+        returnValue = addEntry(dirIndex, fileName, fileIndex);
+        if (returnValue < 0) {
+            releaseRootIndex(fileIndex);
+        } else {
+            superBlock->addFile();
+            superBlockDirty = true;
+            markRootDirty(fileIndex);
+            writeBackMetaDataIfDue();
+        }
+    }
+    return returnValue;
+}
+
+int MyFS::removeFile(int fileIndex, const char *name) {
+    MyFile *file = root[fileIndex];
+    int firstDataBlock = file->getFirstDataBlockIndex();
+    int returnValue = removeEntry(file->getParentIndex(), name);
+    if (returnValue < 0) {
+        return returnValue;
+    }
+    std::vector<int> freedBlocks(getDataBlockCount(fileIndex));
+    getDataBlocks(fileIndex, 0, freedBlocks.size(), freedBlocks.data());
+    if (S_ISDIR(file->getMode())) {
+        releaseDirectoryBlocks(freedBlocks.data(), freedBlocks.size());
+    } else {
+        releaseDataBlocks(freedBlocks.data(), freedBlocks.size());
+    }
+    discardDelayedWrite(fileIndex);
+    readAhead.erase(fileIndex);
+    blockIndex.erase(fileIndex);
+    LogF("File index: %d", fileIndex);
+    LogF("First data block index: %d", firstDataBlock);
+    LogF("Opened file index  %d", file->getOpenIndex());
+    LogF("Current file system size: %lu", currentFileSystemSize);
+    LogF("Open files:  %hu", this->openFiles);
+    if (file->getOpenIndex() >= 0) {
+        this->openFiles--;
     }
-    subString[strlen(subString)] = '\0';
-    return subString;
+    currentFileSystemSize -= file->getFileSize();
+    LogF("Open files now: %hu", openFiles);
+    LogF("File size  %d", file->getFileSize());
+    LogF("New current file system size: %lu", currentFileSystemSize);
+    LogF("File count old: %d", superBlock->getFileCount());
+    superBlock->removeFile();
+    releaseRootIndex(fileIndex);
+    LogF("File count new: %d", superBlock->getFileCount());
+    writeBackMetaDataIfDue();
+    return 0;
 }
 
 void MyFS::logSuperBlockInfos(int log) {
@@ -784,7 +1086,8 @@ void MyFS::logSuperBlockInfos(int log) {
         LogF("FileSystemSize: %ld", superBlock->getFileSystemSize());
         LogF("DMApBlockStart: %d", superBlock->getDMapBlockIndexStart());
         LogF("FATBlockStart: %d", superBlock->getFatBlockIndexStart());
-        LogF("RootBlockStart: %d", superBlock->getRootBlockIndexStart());
+        LogF("InodeTableBlock: %d", superBlock->getInodeTableBlock());
+        LogF("InodeCount: %u", superBlock->getInodeCount());
         LogF("FileCount: : %d", superBlock->getFileCount());
         LOG();
     }
@@ -793,16 +1096,18 @@ void MyFS::logSuperBlockInfos(int log) {
 void MyFS::logDMapAndFatInfos(int log) {
     if (log == 1) {
         for (unsigned int i = 0; i < 65536; i++) {
-            LogF("Index: %d:, DMap-Value: %c Fat-Value: %d", i, dMap[i], fat[i]);
+            LogF("Index: %d:, DMap-Value: %c Fat-Value: %d", i, dMap.isUsed(i) ? 'f' : 'e', getFat(i));
         }
     }
 }
 
 void MyFS::logRootInfos(int log) {
     if (log == 1) {
-        for (unsigned int i = 0; i < superBlock->getFileCount(); i++) {
+        for (unsigned int i = 0; i < root.size(); i++) {
+            if (root[i] == NULL) {
+                continue;
+            }
             LogF("Root: %d", i);
-            LogF("Filename: %s", root[i]->getFileName());
             LogF("Filesize: %d", root[i]->getFileSize());
             LogF("UserID: %d", root[i]->getUserID());
             LogF("GroupID: %d", root[i]->getGroupID());
@@ -811,56 +1116,691 @@ void MyFS::logRootInfos(int log) {
             LogF("MTime: %ld", root[i]->getMTime());
             LogF("CTime: %ld", root[i]->getCTime());
             LogF("FirstDataBlockIndex: %d", root[i]->getFirstDataBlockIndex());
+            LogF("Extents: %u", root[i]->getExtentCount());
             LOG();
         }
     }
 }
 
-int MyFS::checkFileIfNotUsed(char *newFileName) {
-    for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
-        if (hasRootIndexAFile[i] && strcmp(root[i]->getFileName(), newFileName) == 0) {
-            return -i;
+int MyFS::loadFile(int rootIndex) {
+    if (rootIndex < 0 || (unsigned int) rootIndex >= root.size()) {
+        return -EIO;
+    }
+    if (root[rootIndex] != NULL) {
+        return 0;
+    }
+    unsigned int tableBlock = rootIndex / inodesPerBlock;
+    int block;
+    int ret = getInodeTableBlock(tableBlock, &block);
+    char *frame = new char[blockSize];
+    if (ret >= 0) {
+        ret = blockCache->read(dataBlocksIndexStart + block, frame);
+    }
+    //The neighbouring inodes come with the same read, decoding clears the open indices of the last mount
+    for (unsigned int i = tableBlock * inodesPerBlock; ret >= 0 && i < (tableBlock + 1) * inodesPerBlock &&
+                                                      i < root.size(); i++) {
+        if (root[i] == NULL) {
+            root[i] = new MyFile();
+            root[i]->decode(frame + (i % inodesPerBlock) * superBlock->getInodeSize(),
+                            superBlock->getFormatVersion());
         }
     }
-    return 0;
+    delete[] frame;
+    return ret;
 }
 
-int MyFS::findFreeRootIndex() {
-    for (int i = 0; i < NUM_DIR_ENTRIES; i++) {
-        if (hasRootIndexAFile[i] == 0) {
-            return i;
-        }
+int MyFS::getInodeTableBlock(unsigned int tableBlock, int *block) {
+    //The first block is recorded in the superBlock, it holds the inode of the inode table
+    if (tableBlock == 0) {
+        *block = superBlock->getInodeTableBlock();
+    } else if (getDataBlocks(INODE_TABLE, tableBlock, 1, block) < 1) {
+        return -EIO;
     }
-    return -1;
+    return *block >= 0 ? 0 : -EIO;
 }
 
-int MyFS::assignFreeDataBlock() {
-    for (int i = 0; i < D_Map_SIZE; i++) {
-        if (dMap[i] == 'e') {
-            dMap[i] = 'f';
-            fat[i] = -1;
-            return i;
+int MyFS::allocateRootIndex(int *rootIndex) {
+    int ret = 0;
+    int freeInode = superBlock->getFreeInode();
+    if (freeInode >= 0) {
+        ret = loadFile(freeInode);
+        if (ret >= 0) {
+            superBlock->setFreeInode(root[freeInode]->getParentIndex());
+            *rootIndex = freeInode;
+        }
+    } else {
+        //Without free inodes the inode table is extended behind its last inode
+        unsigned int inodeCount = superBlock->getInodeCount();
+        if (inodeCount >= getDataBlockCount(INODE_TABLE) * inodesPerBlock) {
+            ret = growInodeTable();
+        }
+        if (ret >= 0) {
+            superBlock->setInodeCount(inodeCount + 1);
+            root.push_back(NULL);
+            *rootIndex = inodeCount;
         }
     }
-    return -1;
+    if (ret >= 0) {
+        superBlockDirty = true;
+    }
+    return ret;
 }
 
+void MyFS::releaseRootIndex(int rootIndex) {
+    MyFile *file = root[rootIndex];
+    file->setMode(0);
+    file->setParentIndex(superBlock->getFreeInode());
+    superBlock->setFreeInode(rootIndex);
+    superBlockDirty = true;
+    markRootDirty(rootIndex);
+}
+
+int MyFS::growInodeTable() {
+    unsigned int tableBlocks = getDataBlockCount(INODE_TABLE);
+    unsigned int count = std::min(std::max(tableBlocks, 1u), (unsigned int) INODE_TABLE_GROWTH);
+    std::vector<int> blocks(count);
+    int ret = assignFreeDataBlocks(blocks.data(), count, getAppendGoal(INODE_TABLE));
+    if (ret < 0) {
+        return ret;
+    }
+    //The new blocks are written empty, so no inode behind the inode count holds stale data
+    std::vector<char> data((size_t) count * blockSize, 0);
+    std::vector<char *> buffers(count);
+    for (unsigned int j = 0; j < count; j++) {
+        buffers[j] = data.data() + (size_t) j * blockSize;
+    }
+    appendDataBlocks(INODE_TABLE, blocks.data(), count);
+    ret = transferDataBlocks(blocks.data(), buffers.data(), count, true);
+    root[INODE_TABLE]->setFileSize((tableBlocks + count) * blockSize);
+    currentFileSystemSize += (size_t) count * blockSize;
+    markRootDirty(INODE_TABLE);
+    LogF("Inode table grown to %u blocks: %d", tableBlocks + count, ret);
+    return ret;
+}
+
+int MyFS::assignFreeDataBlocks(int *blocks, unsigned int count, int goal) {
+    if (!freeExtents.assign(count, goal, blocks)) {
+        return -ENOSPC;
+    }
+    for (unsigned int j = 0; j < count; j++) {
+        dMap.setUsed(blocks[j]);
+        markDMapDirty(blocks[j]);
+        setFat(blocks[j], -1);
+    }
+    return 0;
+}
 
-void SuperBlock::addFile() {
-    this->fileCount++;
+int MyFS::getAppendGoal(int rootIndex) {
+    int lastBlock = -1;
+    unsigned int blockCount = getDataBlockCount(rootIndex);
+    if (blockCount > 0) {
+        getDataBlocks(rootIndex, blockCount - 1, 1, &lastBlock);
+    }
+    return lastBlock != -1 && lastBlock + 1 < DATA_BLOCKS ? lastBlock + 1 : -1;
 }
 
-void SuperBlock::removeFile() {
-    if (this->fileCount > 0) {
-        this->fileCount--;
+void MyFS::releaseDataBlocks(int *blocks, unsigned int count) {
+    for (unsigned int j = 0; j < count; j++) {
+        setFat(blocks[j], -1);
+        dMap.setFree(blocks[j]);
+        markDMapDirty(blocks[j]);
     }
+    reuseDataBlocks(blocks, count);
 }
 
-unsigned long SuperBlock::getFileSystemSize() {
-    return this->fileSystemSize;
+void MyFS::releaseDirectoryBlocks(const int *blocks, unsigned int count) {
+    for (unsigned int j = 0; j < count; j++) {
+        std::unordered_map<int, char *>::iterator image = dirtyDirectoryBlocks.find(blocks[j]);
+        if (image != dirtyDirectoryBlocks.end()) {
+            delete[] image->second;
+            dirtyDirectoryBlocks.erase(image);
+        }
+        setFat(blocks[j], -1);
+        dMap.setFree(blocks[j]);
+        markDMapDirty(blocks[j]);
+        heldDataBlocks.push_back(blocks[j]);
+    }
 }
 
-unsigned int SuperBlock::getSuperBlockIndexStart() {
+void MyFS::reuseDataBlocks(int *blocks, unsigned int count) {
+    std::sort(blocks, blocks + count);
+    for (unsigned int runStart = 0, runEnd; runStart < count; runStart = runEnd) {
+        for (runEnd = runStart + 1; runEnd < count && blocks[runEnd] == blocks[runEnd - 1] + 1; runEnd++);
+        freeExtents.release(blocks[runStart], runEnd - runStart);
+        //Cached copies must not be written back into the hole
+        blockCache->invalidate(dataBlocksIndexStart + blocks[runStart], runEnd - runStart);
+        if (punchHoles) {
+            pendingDiscards.push_back(blocks[runStart]);
+        }
+    }
+}
+
+void MyFS::discardFreeDataBlocks() {
+    std::sort(pendingDiscards.begin(), pendingDiscards.end());
+    uint64_t unit = BD_DISCARD_ALIGNMENT > blockSize ? BD_DISCARD_ALIGNMENT / blockSize : 1;
+    unsigned int punchedUntil = 0;
+    for (unsigned int j = 0; j < pendingDiscards.size() && punchHoles; j++) {
+        unsigned int first;
+        unsigned int count;
+        if ((unsigned int) pendingDiscards[j] < punchedUntil || !freeExtents.find(pendingDiscards[j], &first, &count)) {
+            continue;
+        }
+        punchedUntil = first + count;
+        uint64_t start = (dataBlocksIndexStart + first + unit - 1) / unit * unit;
+        uint64_t end = (dataBlocksIndexStart + first + count) / unit * unit;
+        if (end <= start) {
+            continue;
+        }
+        int ret = blockDevice->discard(start, end - start);
+        if (ret == -EOPNOTSUPP) {
+            LOG("Container file system cannot punch holes");
+            punchHoles = false;
+        } else if (ret < 0) {
+            LogF("Punching a hole for %u data blocks from data block %d: %d", count, first, ret);
+        }
+    }
+    pendingDiscards.clear();
+}
+
+unsigned int MyFS::getDataBlockCount(int rootIndex) {
+    MyFile *file = root[rootIndex];
+    std::unordered_map<int, BlockIndex>::iterator index = blockIndex.find(rootIndex);
+    if (index != blockIndex.end()) {
+        return index->second.blocks.size();
+    } else if (file->hasExtents()) {
+        return file->getExtentBlocks();
+    }
+    unsigned int count = 0;
+    for (int block = file->getFirstDataBlockIndex(); block != -1; block = getFat(block)) {
+        count++;
+    }
+    return count;
+}
+
+unsigned int MyFS::getDataBlocks(int rootIndex, unsigned int firstBlockNumber, unsigned int count, int *blocks) {
+    MyFile *file = root[rootIndex];
+    std::unordered_map<int, BlockIndex>::iterator index = blockIndex.find(rootIndex);
+    if (index != blockIndex.end()) {
+        std::vector<int> &indexBlocks = index->second.blocks;
+        unsigned int found = 0;
+        for (; found < count && firstBlockNumber + found < indexBlocks.size(); found++) {
+            blocks[found] = indexBlocks[firstBlockNumber + found];
+        }
+        return found;
+    } else if (file->hasExtents()) {
+        return file->findDataBlocks(firstBlockNumber, count, blocks);
+    }
+    int block = file->getFirstDataBlockIndex();
+    for (unsigned int n = 0; n < firstBlockNumber && block != -1; n++) {
+        block = getFat(block);
+    }
+    unsigned int found = 0;
+    for (; found < count && block != -1; block = getFat(block)) {
+        blocks[found++] = block;
+    }
+    return found;
+}
+
+void MyFS::appendDataBlocks(int rootIndex, const int *blocks, unsigned int count) {
+    if (count == 0) {
+        return;
+    }
+    MyFile *file = root[rootIndex];
+    int lastBlock = -1;
+    unsigned int blockCount = getDataBlockCount(rootIndex);
+    if (blockCount > 0) {
+        getDataBlocks(rootIndex, blockCount - 1, 1, &lastBlock);
+    }
+    if (lastBlock == -1) {
+        file->setFirstDataBlockIndex(blocks[0]);
+    } else {
+        setFat(lastBlock, blocks[0]);
+    }
+    for (unsigned int j = 0; j < count; j++) {
+        setFat(blocks[j], j + 1 < count ? blocks[j + 1] : -1);
+    }
+    for (unsigned int runStart = 0, runEnd; runStart < count; runStart = runEnd) {
+        for (runEnd = runStart + 1; runEnd < count && blocks[runEnd] == blocks[runEnd - 1] + 1; runEnd++);
+        file->appendExtent(blocks[runStart], runEnd - runStart);
+    }
+    markRootDirty(rootIndex);
+    std::unordered_map<int, BlockIndex>::iterator index = blockIndex.find(rootIndex);
+    if (index != blockIndex.end()) {
+        index->second.blocks.insert(index->second.blocks.end(), blocks, blocks + count);
+    } else {
+        updateBlockIndex(rootIndex);
+    }
+}
+
+void MyFS::buildExtents(MyFile *file) {
+    file->clearExtents();
+    for (int block = file->getFirstDataBlockIndex(); block != -1 && file->hasExtents(); block = getFat(block)) {
+        file->appendExtent(block, 1);
+    }
+}
+
+void MyFS::updateBlockIndex(int rootIndex) {
+    MyFile *file = root[rootIndex];
+    if ((rootIndex == INODE_TABLE || file->getOpenIndex() >= 0) && !file->hasExtents()) {
+        if (blockIndex.count(rootIndex) == 0) {
+            BlockIndex *index = &blockIndex[rootIndex];
+            for (int block = file->getFirstDataBlockIndex(); block != -1; block = getFat(block)) {
+                index->blocks.push_back(block);
+            }
+            LogF("Block index of %u data blocks built", (unsigned int) index->blocks.size());
+        }
+    } else {
+        blockIndex.erase(rootIndex);
+    }
+}
+
+int MyFS::bufferDelayedWrite(int rootIndex, const char *buf, off_t offset, size_t size) {
+    DelayedWrite *pending = &delayedWrites[rootIndex];
+    if (pending->data == NULL) {
+        pending->start = offset;
+        pending->length = 0;
+        pending->capacity = 0;
+    }
+    size_t end = offset - pending->start + size;
+    if (end > pending->capacity) {
+        //Growing the buffer at least by doubling it, its capacity stays a multiple of the block size
+        size_t capacity = (end + blockSize - 1) / blockSize * blockSize;
+        if (capacity < 2 * pending->capacity) {
+            capacity = 2 * pending->capacity;
+        }
+        char *data = new char[capacity];
+        if (pending->data != NULL) {
+            memcpy(data, pending->data, pending->length);
+            delete[] pending->data;
+        }
+        pending->data = data;
+        delayedWriteBytes += capacity - pending->capacity;
+        pending->capacity = capacity;
+    }
+    memcpy(pending->data + (offset - pending->start), buf, size);
+    if (end > pending->length) {
+        pending->length = end;
+    }
+    //Memory pressure, the content of this file is written now
+    if (delayedWriteBytes > DELAYED_WRITE_BUDGET) {
+        LogF("Delayed write budget exceeded: %zu bytes buffered", delayedWriteBytes);
+        return commitDelayedWrite(rootIndex);
+    }
+    return 0;
+}
+
+int MyFS::commitDelayedWrite(int rootIndex) {
+    std::unordered_map<int, DelayedWrite>::iterator found = delayedWrites.find(rootIndex);
+    if (found == delayedWrites.end()) {
+        return 0;
+    }
+    DelayedWrite *pending = &found->second;
+    unsigned int count = (pending->length + blockSize - 1) / blockSize;
+    int *blocks = new int[count];
+    int ret = assignFreeDataBlocks(blocks, count, getAppendGoal(rootIndex));
+    if (ret >= 0 && count > 0) {
+        appendDataBlocks(rootIndex, blocks, count);
+        //Writing every run of contiguous data blocks with one request, bypassing the block cache
+        memset(pending->data + pending->length, 0, (size_t) count * blockSize - pending->length);
+        BlockBatch batch(blockSize);
+        for (unsigned int runStart = 0, runEnd; runStart < count; runStart = runEnd) {
+            for (runEnd = runStart + 1; runEnd < count && blocks[runEnd] == blocks[runEnd - 1] + 1; runEnd++);
+            blockCache->invalidate(dataBlocksIndexStart + blocks[runStart], runEnd - runStart);
+            batch.queueWrite(dataBlocksIndexStart + blocks[runStart], runEnd - runStart,
+                             pending->data + (size_t) runStart * blockSize);
+        }
+        ret = blockDevice->submit(&batch);
+        LogF("Delayed write of %u data blocks from data block %d: %d", count, blocks[0], ret);
+    }
+    delete[] blocks;
+    if (ret >= 0) {
+        discardDelayedWrite(rootIndex);
+    }
+    return ret;
+}
+
+void MyFS::discardDelayedWrite(int rootIndex) {
+    std::unordered_map<int, DelayedWrite>::iterator pending = delayedWrites.find(rootIndex);
+    if (pending != delayedWrites.end()) {
+        delete[] pending->second.data;
+        delayedWriteBytes -= pending->second.capacity;
+        delayedWrites.erase(pending);
+    }
+}
+
+bool MyFS::copyMappedDataBlocks(const int *blocks, unsigned int count, off_t offset, char *buf, size_t size,
+                                bool write) {
+    off_t firstBlockStart = offset - offset % blockSize;
+    //Blocks held by the block cache may be newer than the mapping
+    for (unsigned int j = 0; j < count; j++) {
+        if (blockDevice->getBlockPointer(dataBlocksIndexStart + blocks[j]) == NULL ||
+            blockCache->contains(dataBlocksIndexStart + blocks[j])) {
+            return false;
+        }
+    }
+    for (unsigned int j = 0; j < count; j++) {
+        off_t blockStart = firstBlockStart + (off_t) j * blockSize;
+        off_t from = offset > blockStart ? offset : blockStart;
+        off_t to = (off_t) (offset + size) < blockStart + blockSize ? (off_t) (offset + size) :
+                   blockStart + blockSize;
+        char *block = blockDevice->getBlockPointer(dataBlocksIndexStart + blocks[j]) + (from - blockStart);
+        if (write) {
+            memcpy(block, buf + (from - offset), to - from);
+        } else {
+            memcpy(buf + (from - offset), block, to - from);
+        }
+    }
+    return true;
+}
+
+int MyFS::transferDataBlocks(const int *blocks, char **buffers, unsigned int count, bool write) {
+    uint64_t *deviceBlocks = new uint64_t[count];
+    for (unsigned int j = 0; j < count; j++) {
+        deviceBlocks[j] = dataBlocksIndexStart + blocks[j];
+    }
+    int ret;
+    if (write) {
+        ret = blockCache->writeBlocks(deviceBlocks, buffers, count);
+    } else {
+        ret = blockCache->readBlocks(deviceBlocks, buffers, count);
+    }
+    delete[] deviceBlocks;
+    return ret;
+}
+
+void MyFS::readAheadAfter(int rootIndex, off_t offset, size_t size) {
+    ReadAhead *state = &readAhead[rootIndex];
+    unsigned int lastBlockNumber = (offset + size - 1) / blockSize;
+    unsigned int minWindow = READ_AHEAD_MIN_SIZE > blockSize ? READ_AHEAD_MIN_SIZE / blockSize : 1;
+    unsigned int maxWindow = READ_AHEAD_MAX_SIZE > blockSize ? READ_AHEAD_MAX_SIZE / blockSize : 1;
+    if (offset != state->nextOffset) {
+        state->window = 0;
+        state->prefetchedUntil = 0;
+    } else if (state->window == 0) {
+        state->window = minWindow;
+    } else {
+        state->window = state->window * 2 < maxWindow ? state->window * 2 : maxWindow;
+    }
+    state->nextOffset = offset + size;
+    //Prefetching again once less than half of the window is left
+    if (state->window == 0 || state->prefetchedUntil > lastBlockNumber + 1 + state->window / 2) {
+        return;
+    }
+    unsigned int from = state->prefetchedUntil > lastBlockNumber + 1 ? state->prefetchedUntil : lastBlockNumber + 1;
+    unsigned int until = lastBlockNumber + 1 + state->window;
+    int *blocks = new int[until - from];
+    uint64_t *prefetchBlocks = new uint64_t[until - from];
+    unsigned int count = getDataBlocks(rootIndex, from, until - from, blocks);
+    for (unsigned int j = 0; j < count; j++) {
+        prefetchBlocks[j] = dataBlocksIndexStart + blocks[j];
+    }
+    state->prefetchedUntil = from + count;
+    if (count > 0 && blockDevice->getBlockPointer(prefetchBlocks[0]) != NULL) {
+        //A mapped container is read from the host page cache, every run of contiguous blocks is read into it
+        LogF("Read ahead of %u mapped blocks, window %u", count, state->window);
+        for (unsigned int runStart = 0, runEnd; runStart < count; runStart = runEnd) {
+            for (runEnd = runStart + 1; runEnd < count && blocks[runEnd] == blocks[runEnd - 1] + 1; runEnd++);
+            blockDevice->willNeed(prefetchBlocks[runStart], runEnd - runStart);
+        }
+    } else if (count > 0) {
+        LogF("Read ahead of %u blocks, window %u", count, state->window);
+        blockCache->prefetchAsync(prefetchBlocks, count);
+    }
+    delete[] blocks;
+    delete[] prefetchBlocks;
+}
+
+int MyFS::loadFatBlock(unsigned int fatBlock) {
+    if (loadedFatBlocks[fatBlock]) {
+        return 0;
+    }
+    int ret = blockCache->read(superBlock->getFatBlockIndexStart() + fatBlock, (char *) fat + fatBlock * blockSize);
+    if (ret >= 0) {
+        loadedFatBlocks[fatBlock] = true;
+    } else {
+        LogF("Reading fat block %u failed: %d", fatBlock, ret);
+    }
+    return ret;
+}
+
+int MyFS::getFat(int block) {
+    return loadFatBlock((unsigned int) block * sizeof(int) / blockSize) < 0 ? -1 : fat[block];
+}
+
+void MyFS::setFat(int block, int next) {
+    //The whole fat block is written back, so it is read before it changes
+    unsigned int fatBlock = (unsigned int) block * sizeof(int) / blockSize;
+    if (loadFatBlock(fatBlock) >= 0) {
+        fat[block] = next;
+        dirtyMetaBlocks[superBlock->getDMapBlocks() + fatBlock] = true;
+        metaDataDirty = true;
+    }
+}
+
+void MyFS::markDMapDirty(int block) {
+    dirtyMetaBlocks[block / 8 / blockSize] = true;
+    metaDataDirty = true;
+}
+
+void MyFS::updateATime(int rootIndex) {
+    MyFile *file = root[rootIndex];
+    time_t now = time(nullptr);
+    if (file->getATime() <= file->getMTime() || file->getATime() <= file->getCTime() ||
+        now - file->getATime() >= ATIME_UPDATE_INTERVAL) {
+        file->setATime(now);
+        markRootDirty(rootIndex);
+    }
+}
+
+void MyFS::markRootDirty(int rootIndex) {
+    dirtyInodes.insert(rootIndex);
+    metaDataDirty = true;
+}
+
+int MyFS::writeMetaData() {
+    int ret = 0;
+    if (superBlock->getUsedSize() != currentFileSystemSize) {
+        superBlock->setUsedSize(currentFileSystemSize);
+        superBlockDirty = true;
+    }
+    //Collecting the superBlock and the dirty DMap and fat blocks, they follow each other on the block device
+    unsigned int dMapBlocks = superBlock->getDMapBlocks();
+    std::vector<uint64_t> blocks;
+    std::vector<char *> buffers;
+    std::vector<char *> frames;
+    if (superBlockDirty) {
+        char *frame = new char[blockSize];
+        memset(frame, 0, blockSize);
+        superBlock->encode(frame);
+        frames.push_back(frame);
+        blocks.push_back(SUPER_BLOCK_BLOCK_INDEX_START);
+        buffers.push_back(frame);
+    }
+    for (unsigned int i = 0; i < dirtyMetaBlocks.size(); i++) {
+        if (!dirtyMetaBlocks[i]) {
+            continue;
+        }
+        blocks.push_back(superBlock->getDMapBlockIndexStart() + i);
+        if (i < dMapBlocks) {
+            buffers.push_back(dMap.getData() + i * blockSize);
+        } else {
+            buffers.push_back((char *) fat + (i - dMapBlocks) * blockSize);
+        }
+    }
+    //A dirty inode is written with its whole inode table block, the other loaded inodes of the block are copied
+    //into it as well
+    std::vector<unsigned int> tableBlocks;
+    for (std::unordered_set<int>::iterator i = dirtyInodes.begin(); i != dirtyInodes.end(); i++) {
+        tableBlocks.push_back(*i / inodesPerBlock);
+    }
+    std::sort(tableBlocks.begin(), tableBlocks.end());
+    tableBlocks.erase(std::unique(tableBlocks.begin(), tableBlocks.end()), tableBlocks.end());
+    for (unsigned int j = 0; j < tableBlocks.size() && ret >= 0; j++) {
+        int block = -1;
+        char *frame = new char[blockSize];
+        frames.push_back(frame);
+        ret = getInodeTableBlock(tableBlocks[j], &block);
+        if (ret >= 0) {
+            ret = blockCache->read(dataBlocksIndexStart + block, frame);
+        }
+        for (unsigned int i = tableBlocks[j] * inodesPerBlock; i < (tableBlocks[j] + 1) * inodesPerBlock &&
+                                                              i < root.size(); i++) {
+            if (root[i] != NULL) {
+                root[i]->encode(frame + (i % inodesPerBlock) * superBlock->getInodeSize());
+            }
+        }
+        blocks.push_back(dataBlocksIndexStart + block);
+        buffers.push_back(frame);
+    }
+    for (std::unordered_map<int, char *>::iterator i = dirtyDirectoryBlocks.begin();
+         i != dirtyDirectoryBlocks.end(); i++) {
+        blocks.push_back(dataBlocksIndexStart + i->first);
+        buffers.push_back(i->second);
+    }
+    //The blocks of a resized directory are on the block device before its inode refers to them
+    if (ret >= 0 && unflushedDirectoryBlocks) {
+        ret = blockCache->flush();
+        if (ret >= 0) {
+            ret = blockDevice->sync();
+        }
+    }
+    if (ret >= 0 && !blocks.empty()) {
+        //The changes of all operations since the last commit form one transaction
+        if (journal != NULL) {
+            ret = journal->commit(blocks.data(), buffers.data(), blocks.size());
+            LogF("Journal commit of %u blocks: %d", (unsigned int) blocks.size(), ret);
+        }
+        if (ret >= 0) {
+            ret = blockCache->writeBlocks(blocks.data(), buffers.data(), blocks.size());
+            metaDataBlocksWritten += blocks.size();
+        }
+        if (ret >= 0 && journal == NULL) {
+            ret = blockCache->flush();
+            if (ret >= 0) {
+                ret = blockDevice->sync();
+            }
+        }
+    }
+    for (unsigned int j = 0; j < frames.size(); j++) {
+        delete[] frames[j];
+    }
+    if (ret >= 0) {
+        dirtyMetaBlocks.assign(dirtyMetaBlocks.size(), false);
+        dirtyInodes.clear();
+        for (std::unordered_map<int, char *>::iterator i = dirtyDirectoryBlocks.begin();
+             i != dirtyDirectoryBlocks.end(); i++) {
+            delete[] i->second;
+        }
+        dirtyDirectoryBlocks.clear();
+        unflushedDirectoryBlocks = false;
+        superBlockDirty = false;
+        metaDataDirty = false;
+        metaDataWrittenBack = time(nullptr);
+        if (journal != NULL && journal->isFull()) {
+            ret = checkpointJournal();
+        } else if (journal == NULL && !heldDataBlocks.empty()) {
+            //Without a journal the released directory blocks are free on the block device now
+            reuseDataBlocks(heldDataBlocks.data(), heldDataBlocks.size());
+            heldDataBlocks.clear();
+        }
+        //The released blocks are punched once their release is committed
+        discardFreeDataBlocks();
+    }
+    return ret;
+}
+
+uint64_t MyFS::getMetaDataBlocksWritten() {
+    return metaDataBlocksWritten;
+}
+
+void MyFS::writeBackMetaDataIfDue() {
+    if (metaDataDirty || superBlockDirty) {
+        if (time(nullptr) - metaDataWrittenBack >= META_DATA_WRITE_BACK_INTERVAL ||
+            dirtyInodes.size() >= JOURNAL_TRANSACTION_INODES ||
+            dirtyDirectoryBlocks.size() >= JOURNAL_TRANSACTION_INODES) {
+            int ret = writeMetaData();
+            if (ret < 0) {
+                LogF("Meta data write back failed: %d", ret);
+            }
+        }
+    }
+}
+
+int MyFS::replayJournal() {
+    journal = new Journal(blockDevice, blockSize, superBlock->getJournalBlockIndexStart(),
+                          superBlock->getJournalBlocks(), superBlock->getJournalTransactionBlocks());
+    int ret = journal->replay(superBlock->getJournalSequence());
+    LogF("Replayed journal transactions: %d", ret);
+    if (ret > 0) {
+        ret = blockDevice->sync();
+        //The superBlock may have been replayed, the journal starts over behind the replayed transactions
+        char *frame = new char[blockSize];
+        if (ret >= 0) {
+            ret = blockDevice->read(SUPER_BLOCK_BLOCK_INDEX_START, frame);
+        }
+        if (ret >= 0) {
+            ret = superBlock->decode(frame);
+        }
+        if (ret >= 0) {
+            superBlock->setJournalSequence(journal->getSequence());
+            memset(frame, 0, blockSize);
+            superBlock->encode(frame);
+            ret = blockDevice->write(SUPER_BLOCK_BLOCK_INDEX_START, frame);
+        }
+        delete[] frame;
+        if (ret >= 0) {
+            ret = blockDevice->sync();
+        }
+    }
+    journal->reset(journal->getSequence());
+    return ret < 0 ? ret : 0;
+}
+
+int MyFS::checkpointJournal() {
+    int ret = blockCache->flush();
+    if (ret >= 0) {
+        ret = blockDevice->sync();
+    }
+    if (ret >= 0) {
+        journal->reset(journal->getSequence());
+        superBlock->setJournalSequence(journal->getSequence());
+        char *frame = new char[blockSize];
+        memset(frame, 0, blockSize);
+        superBlock->encode(frame);
+        ret = blockCache->write(SUPER_BLOCK_BLOCK_INDEX_START, frame);
+        delete[] frame;
+    }
+    if (ret >= 0) {
+        ret = blockCache->flush();
+    }
+    if (ret >= 0) {
+        ret = blockDevice->sync();
+    }
+    //No transaction is replayed anymore, so the released directory blocks may be overwritten
+    if (ret >= 0 && !heldDataBlocks.empty()) {
+        reuseDataBlocks(heldDataBlocks.data(), heldDataBlocks.size());
+        heldDataBlocks.clear();
+        discardFreeDataBlocks();
+    }
+    LogF("Journal checkpoint: %d", ret);
+    return ret;
+}
+
+void SuperBlock::addFile() {
+    this->fileCount++;
+}
+
+void SuperBlock::removeFile() {
+    if (this->fileCount > 0) {
+        this->fileCount--;
+    }
+}
+
+unsigned long SuperBlock::getFileSystemSize() {
+    return this->fileSystemSize;
+}
+
+unsigned int SuperBlock::getSuperBlockIndexStart() {
     return this->superBlockBlockIndexStart;
 }
 
@@ -872,19 +1812,88 @@ unsigned int SuperBlock::getFatBlockIndexStart() {
     return this->fatBlockIndexStart;
 }
 
-unsigned int SuperBlock::getRootBlockIndexStart() {
-    return this->rootBlockIndexStart;
-}
-
 unsigned int SuperBlock::getFileCount() {
     return this->fileCount;
 }
 
+unsigned int SuperBlock::getBlockSize() {
+    //File systems created before the block size was configurable use BLOCK_SIZE
+    return this->blockSize != 0 ? this->blockSize : BLOCK_SIZE;
+}
+
+unsigned int SuperBlock::getDMapBlocks() {
+    return this->fatBlockIndexStart - this->dMapBlockIndexStart;
+}
+
+unsigned int SuperBlock::getFatBlocks() {
+    return this->journalBlockIndexStart - this->fatBlockIndexStart;
+}
+
+unsigned int SuperBlock::getDataBlockIndexStart() {
+    return this->dataBlockIndexStart;
+}
+
+unsigned int SuperBlock::getJournalBlockIndexStart() {
+    return this->journalBlockIndexStart;
+}
+
+unsigned int SuperBlock::getJournalBlocks() {
+    return this->dataBlockIndexStart - this->journalBlockIndexStart;
+}
+
+unsigned int SuperBlock::getJournalTransactionBlocks() {
+    return this->journalBlockIndexStart + 4 * JOURNAL_TRANSACTION_INODES;
+}
+
+uint64_t SuperBlock::getJournalSequence() {
+    return this->journalSequence;
+}
+
+void SuperBlock::setJournalSequence(uint64_t newJournalSequence) {
+    this->journalSequence = newJournalSequence;
+}
+
+int SuperBlock::getInodeTableBlock() {
+    return this->inodeTableBlock;
+}
+
+void SuperBlock::setInodeTableBlock(int newInodeTableBlock) {
+    this->inodeTableBlock = newInodeTableBlock;
+}
+
+unsigned int SuperBlock::getInodeCount() {
+    return this->inodeCount;
+}
+
+void SuperBlock::setInodeCount(unsigned int newInodeCount) {
+    this->inodeCount = newInodeCount;
+}
+
+int SuperBlock::getFreeInode() {
+    return this->freeInode;
+}
+
+void SuperBlock::setFreeInode(int newFreeInode) {
+    this->freeInode = newFreeInode;
+}
+
+unsigned int SuperBlock::getFormatVersion() {
+    return this->formatVersion;
+}
+
+unsigned long SuperBlock::getUsedSize() {
+    return this->usedSize;
+}
+
+void SuperBlock::setUsedSize(unsigned long newUsedSize) {
+    this->usedSize = newUsedSize;
+}
 
-void MyFile::setFileName(char *newFileName) {
-    strcpy(this->fileName, newFileName);
+unsigned int SuperBlock::getInodeSize() {
+    return this->inodeSize;
 }
 
+
 void MyFile::setFileSize(unsigned int newFileSize) {
     this->fileSize = newFileSize;
 }
@@ -925,10 +1934,8 @@ void MyFile::clearOpenIndex() {
     this->openIndex = -1;
 }
 
-char *MyFile::getFileName() {
-    char *file = new char[strlen(this->fileName) + 1];
-    strcpy(file, this->fileName);
-    return file;
+void MyFile::setParentIndex(int newParentIndex) {
+    this->parentIndex = newParentIndex;
 }
 
 unsigned int MyFile::getFileSize() {
@@ -967,6 +1974,92 @@ short int MyFile::getOpenIndex() {
     return this->openIndex;
 }
 
+int MyFile::getParentIndex() {
+    return this->parentIndex;
+}
+
+void MyFile::clearExtents() {
+    this->extentCount = 0;
+}
+
+bool MyFile::hasInlineData() {
+    return (this->flags & INODE_INLINE_DATA) != 0;
+}
+
+const char *MyFile::getInlineData() {
+    return this->inlineData;
+}
+
+void MyFile::setInlineData(const char *data, unsigned int size) {
+    this->extentCount = 0;
+    memset(this->inlineData, 0, INLINE_DATA_SIZE);
+    memcpy(this->inlineData, data, size);
+    this->flags |= INODE_INLINE_DATA;
+}
+
+void MyFile::clearInlineData() {
+    this->flags &= ~INODE_INLINE_DATA;
+    this->extentCount = 0;
+}
+
+bool MyFile::hasExtents() {
+    return this->extentCount <= FILE_EXTENTS;
+}
+
+unsigned int MyFile::getExtentCount() {
+    return this->extentCount;
+}
+
+unsigned int MyFile::getExtentBlocks() {
+    if (this->extentCount == 0 || !hasExtents()) {
+        return 0;
+    }
+    return this->extents[this->extentCount - 1].fileBlock + this->extents[this->extentCount - 1].length;
+}
+
+void MyFile::appendExtent(int dataBlock, unsigned int count) {
+    if (!hasExtents() || count == 0) {
+        return;
+    }
+    Extent *last = this->extentCount > 0 ? &this->extents[this->extentCount - 1] : NULL;
+    if (last != NULL && last->dataBlock + (int) last->length == dataBlock) {
+        last->length += count;
+    } else if (this->extentCount < FILE_EXTENTS) {
+        this->extents[this->extentCount].fileBlock = getExtentBlocks();
+        this->extents[this->extentCount].dataBlock = dataBlock;
+        this->extents[this->extentCount].length = count;
+        this->extentCount++;
+    } else {
+        this->extentCount = FILE_EXTENTS + 1;
+    }
+}
+
+void MyFile::truncateExtents(unsigned int blocks) {
+    while (this->extentCount > 0 && this->extents[this->extentCount - 1].fileBlock >= blocks) {
+        this->extentCount--;
+    }
+    if (this->extentCount > 0 && getExtentBlocks() > blocks) {
+        this->extents[this->extentCount - 1].length = blocks - this->extents[this->extentCount - 1].fileBlock;
+    }
+}
+
+unsigned int MyFile::findDataBlocks(unsigned int fileBlock, unsigned int count, int *blocks) {
+    //The extent holding fileBlock is the last one starting at or before it
+    unsigned int e = std::upper_bound(this->extents, this->extents + this->extentCount, fileBlock,
+                                      [](unsigned int block, const Extent &extent) {
+                                          return block < extent.fileBlock;
+                                      }) - this->extents;
+    unsigned int found = 0;
+    for (e = e > 0 ? e - 1 : 0; e < this->extentCount && found < count; e++) {
+        Extent *extent = &this->extents[e];
+        for (unsigned int block = fileBlock + found; block < extent->fileBlock + extent->length && found < count;
+             block++) {
+            blocks[found++] = extent->dataBlock + (block - extent->fileBlock);
+        }
+    }
+    return found;
+}
+
 //Methods which are not implemented
 int MyFS::fuseReadlink(const char *path, char *link, size_t size) {
     //LogM();
@@ -974,13 +2067,29 @@ int MyFS::fuseReadlink(const char *path, char *link, size_t size) {
 }
 
 int MyFS::fuseMkdir(const char *path, mode_t mode) {
-    //LogM();
-    return 0;
+    LogM();
+    int returnValue = createFile(path, S_IFDIR | mode);
+    RETURN(returnValue)
 }
 
 int MyFS::fuseRmdir(const char *path) {
-    //LogM();
-    return 0;
+    LogM();
+    unsigned int count = 0;
+    int returnValue = findFile(path);
+    int fileIndex = returnValue;
+    if (returnValue >= 0 && !S_ISDIR(root[fileIndex]->getMode())) {
+        returnValue = -ENOTDIR;
+    } else if (returnValue >= 0) {
+        returnValue = getEntryCount(fileIndex, &count);
+    }
+    if (returnValue >= 0 && count > 0) {
+        returnValue = -ENOTEMPTY;
+    } else if (returnValue >= 0) {
+        const char *name = strrchr(path, '/') + 1;
+        dentryCache.erase(getDentryKey(root[fileIndex]->getParentIndex(), name, strlen(name)));
+        returnValue = removeFile(fileIndex, name);
+    }
+    RETURN(returnValue)
 }
 
 int MyFS::fuseSymlink(const char *path, const char *link) {
@@ -989,8 +2098,61 @@ int MyFS::fuseSymlink(const char *path, const char *link) {
 }
 
 int MyFS::fuseRename(const char *path, const char *newpath) {
-    //LogM();
-    return 0;
+    LogM();
+    int dirIndex = ROOT_DIRECTORY;
+    const char *newName;
+    int targetIndex = -1;
+    int fileIndex = findFile(path);
+    int returnValue = fileIndex;
+    if (returnValue >= 0) {
+        returnValue = resolvePath(newpath, &dirIndex, &newName);
+    }
+    //A directory cannot be moved into itself
+    for (int d = dirIndex; returnValue >= 0 && d != ROOT_DIRECTORY; d = root[d]->getParentIndex()) {
+        if (d == fileIndex) {
+            returnValue = -EINVAL;
+        }
+    }
+    if (returnValue >= 0) {
+        returnValue = findEntry(dirIndex, newName, strlen(newName), &targetIndex);
+        if (returnValue == -ENOENT) {
+            targetIndex = -1;
+            returnValue = 0;
+        }
+    }
+    //An existing file or empty directory with the new name is replaced
+    if (returnValue >= 0 && targetIndex >= 0 && targetIndex != fileIndex) {
+        bool isDirectory = S_ISDIR(root[fileIndex]->getMode());
+        if (S_ISDIR(root[targetIndex]->getMode()) != isDirectory) {
+            returnValue = isDirectory ? -ENOTDIR : -EISDIR;
+        } else {
+            returnValue = isDirectory ? fuseRmdir(newpath) : removeFile(targetIndex, newName);
+        }
+    }
+    if (returnValue >= 0 && targetIndex != fileIndex) {
+        MyFile *file = root[fileIndex];
+        int oldDirIndex = file->getParentIndex();
+        const char *oldName = strrchr(path, '/') + 1;
+        returnValue = removeEntry(oldDirIndex, oldName);
+        if (returnValue >= 0) {
+            file->setParentIndex(dirIndex);
+            returnValue = addEntry(dirIndex, newName, fileIndex);
+            if (returnValue < 0) {
+                file->setParentIndex(oldDirIndex);
+                addEntry(oldDirIndex, oldName, fileIndex);
+            }
+        }
+        if (returnValue >= 0) {
+            file->setCTime(time(nullptr));
+            markRootDirty(fileIndex);
+            //The directories below a moved directory stay cached under their parents
+            if (S_ISDIR(file->getMode())) {
+                dentryCache.erase(getDentryKey(oldDirIndex, oldName, strlen(oldName)));
+            }
+            writeBackMetaDataIfDue();
+        }
+    }
+    RETURN(returnValue)
 }
 
 int MyFS::fuseLink(const char *path, const char *newpath) {
@@ -1009,8 +2171,84 @@ int MyFS::fuseChown(const char *path, uid_t uid, gid_t gid) {
 }
 
 int MyFS::fuseTruncate(const char *path, off_t newSize) {
-    //LogM();
-    return 0;
+    LogM();
+    int returnValue = 0;
+    int fileIndex = findFile(path);
+    if (fileIndex < 0) {
+        returnValue = fileIndex;
+    } else if (S_ISDIR(root[fileIndex]->getMode())) {
+        returnValue = -EISDIR;
+    } else if (newSize < 0 || newSize > (off_t) superBlock->getFileSystemSize()) {
+        returnValue = -EINVAL;
+    } else {
+        MyFile *file = root[fileIndex];
+        off_t oldFileSize = file->getFileSize();
+        LogF("Truncating %s from %ld to %ld", path, oldFileSize, newSize);
+        returnValue = commitDelayedWrite(fileIndex);
+        if (returnValue >= 0 && newSize < oldFileSize) {
+            //Releasing the data blocks behind the new end of the file
+            unsigned int keepBlocks = (newSize + blockSize - 1) / blockSize;
+            unsigned int blockCount = getDataBlockCount(fileIndex);
+            std::vector<int> freedBlocks;
+            if (keepBlocks < blockCount) {
+                freedBlocks.resize(blockCount - keepBlocks);
+                getDataBlocks(fileIndex, keepBlocks, freedBlocks.size(), freedBlocks.data());
+                int lastBlock = -1;
+                if (keepBlocks > 0) {
+                    getDataBlocks(fileIndex, keepBlocks - 1, 1, &lastBlock);
+                }
+                if (lastBlock == -1) {
+                    file->setFirstDataBlockIndex(-1);
+                } else {
+                    setFat(lastBlock, -1);
+                }
+                if (file->hasExtents()) {
+                    file->truncateExtents(keepBlocks);
+                } else {
+                    buildExtents(file);
+                }
+                std::unordered_map<int, BlockIndex>::iterator index = blockIndex.find(fileIndex);
+                if (index != blockIndex.end()) {
+                    index->second.blocks.resize(keepBlocks);
+                }
+                updateBlockIndex(fileIndex);
+            }
+            releaseDataBlocks(freedBlocks.data(), freedBlocks.size());
+            file->setFileSize(newSize);
+            currentFileSystemSize -= oldFileSize - newSize;
+        } else if (returnValue >= 0 && newSize > oldFileSize) {
+            //Appending zeros, the file system has no holes
+            if (currentFileSystemSize + (newSize - oldFileSize) > superBlock->getFileSystemSize()) {
+                returnValue = -ENOSPC;
+            }
+            struct fuse_file_info fileInfo = {};
+            fileInfo.fh = fileIndex;
+            char *zeros = new char[BLOCK_SIZE_MAX];
+            memset(zeros, 0, BLOCK_SIZE_MAX);
+            for (off_t offset = oldFileSize; offset < newSize && returnValue >= 0; offset += returnValue) {
+                size_t size = newSize - offset < BLOCK_SIZE_MAX ? newSize - offset : BLOCK_SIZE_MAX;
+                returnValue = fuseWrite(path, zeros, size, offset, &fileInfo);
+                if (returnValue == 0) {
+                    returnValue = -ENOSPC;
+                }
+            }
+            delete[] zeros;
+            //The zeros of a file which is not open are not left buffered
+            if (file->getOpenIndex() < 0) {
+                int ret = commitDelayedWrite(fileIndex);
+                if (returnValue >= 0) {
+                    returnValue = ret;
+                }
+            }
+        }
+        if (returnValue >= 0) {
+            file->setMTime(time(nullptr));
+            markRootDirty(fileIndex);
+            writeBackMetaDataIfDue();
+            returnValue = 0;
+        }
+    }
+    RETURN(returnValue)
 }
 
 int MyFS::fuseUtime(const char *path, struct utimbuf *ubuf) {
@@ -1024,13 +2262,31 @@ int MyFS::fuseStatfs(const char *path, struct statvfs *statInfo) {
 }
 
 int MyFS::fuseFlush(const char *path, struct fuse_file_info *fileInfo) {
-    //LogM();
-    return 0;
+    LogM();
+    int returnValue = 0;
+    if (fileInfo->fh < root.size()) {
+        returnValue = commitDelayedWrite(fileInfo->fh);
+    }
+    RETURN(returnValue)
 }
 
 int MyFS::fuseFsync(const char *path, int datasync, struct fuse_file_info *fileInfo) {
-    //LogM();
-    return 0;
+    LogM();
+    int returnValue = 0;
+    while (!delayedWrites.empty() && returnValue >= 0) {
+        returnValue = commitDelayedWrite(delayedWrites.begin()->first);
+    }
+    //Data blocks are durable before the meta data referring to them is committed
+    if (returnValue >= 0) {
+        returnValue = blockCache->flush();
+    }
+    if (returnValue >= 0) {
+        returnValue = blockDevice->sync();
+    }
+    if (returnValue >= 0) {
+        returnValue = writeMetaData();
+    }
+    RETURN(returnValue)
 }
 
 int MyFS::fuseListxattr(const char *path, char *list, size_t size) {
@@ -1067,9 +2323,7 @@ int MyFS::fuseFsyncdir(const char *path, int datasync, struct fuse_file_info *fi
 }
 
 int MyFS::fuseTruncate(const char *path, off_t offset, struct fuse_file_info *fileInfo) {
-    //LogM();
-    //RETURN(0)
-    return 0;
+    return fuseTruncate(path, offset);
 }
 
 int MyFS::fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileInfo) {
@@ -1080,7 +2334,50 @@ int MyFS::fuseCreate(const char *path, mode_t mode, struct fuse_file_info *fileI
 }
 
 void MyFS::fuseDestroy() {
-//    LogM();
+    LogM();
+    if (blockCache != NULL) {
+        //Buffered content is only dropped once it is written, a failed file is tried once more after the meta data
+        //write back made the data blocks released since the last commit reusable
+        for (int pass = 0; pass < 2 && !delayedWrites.empty(); pass++) {
+            if (pass > 0) {
+                writeMetaData();
+                if (journal != NULL) {
+                    checkpointJournal();
+                }
+            }
+            std::vector<int> rootIndexes;
+            for (std::unordered_map<int, DelayedWrite>::iterator pending = delayedWrites.begin();
+                 pending != delayedWrites.end(); pending++) {
+                rootIndexes.push_back(pending->first);
+            }
+            for (size_t i = 0; i < rootIndexes.size(); i++) {
+                int ret = commitDelayedWrite(rootIndexes[i]);
+                if (ret < 0) {
+                    LogF("Delayed write of file %d failed: %d", rootIndexes[i], ret);
+                }
+            }
+        }
+        if (!delayedWrites.empty()) {
+            LogF("Buffered content of %u files is lost", (unsigned int) delayedWrites.size());
+        }
+        writeMetaData();
+        if (journal != NULL) {
+            //The journal is empty on the next mount
+            checkpointJournal();
+            LogF("Journal commits: %lu", (unsigned long) journal->getCommits());
+            delete journal;
+            journal = NULL;
+        }
+        blockCache->flush();
+        LogF("Meta data blocks written: %lu", (unsigned long) metaDataBlocksWritten);
+        LogF("Block cache hits: %lu, misses: %lu, write backs: %lu, prefetched: %lu",
+             (unsigned long) blockCache->getHits(), (unsigned long) blockCache->getMisses(),
+             (unsigned long) blockCache->getWriteBacks(), (unsigned long) blockCache->getPrefetched());
+        delete blockCache;
+        blockCache = NULL;
+    }
+    blockDevice->sync();
+    blockDevice->close();
 }
 
 #ifdef __APPLE__
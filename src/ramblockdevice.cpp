@@ -0,0 +1,226 @@
+//
+//  ramblockdevice.cpp
+//  myfs
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ramblockdevice.h"
+
+RamBlockDevice::RamBlockDevice(u_int32_t blockSize) : BlockBackend(blockSize) {
+    this->size = 0;
+    this->mapped = false;
+    pthread_rwlock_init(&this->chunkLock, NULL);
+}
+
+RamBlockDevice::~RamBlockDevice() {
+    freeChunks();
+    pthread_rwlock_destroy(&this->chunkLock);
+}
+
+void RamBlockDevice::freeChunks() {
+    for (size_t c = 0; c < this->chunks.size(); c++)
+        free(this->chunks[c]);
+    this->chunks.clear();
+    this->size = 0;
+    this->mapped = false;
+}
+
+// returns the chunk or NULL if it holds only zeros, the caller holds chunkLock for writing if allocate is set
+char *RamBlockDevice::getChunk(size_t chunk, bool allocate) {
+    if (chunk >= this->chunks.size()) {
+        if (!allocate)
+            return NULL;
+        this->chunks.resize(chunk + 1, NULL);
+    }
+    if (this->chunks[chunk] == NULL && allocate)
+        this->chunks[chunk] = (char *) calloc(1, RD_CHUNK_SIZE);
+    return this->chunks[chunk];
+}
+
+int RamBlockDevice::open(const char *path, int flags) {
+    freeChunks();
+
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0)
+        return -errno;
+
+    // all zero chunks of the image stay unallocated
+    char *chunk = (char *) malloc(RD_CHUNK_SIZE);
+    int ret = 0;
+    for (size_t c = 0; chunk != NULL; c++) {
+        ssize_t length = 0;
+        while (length < RD_CHUNK_SIZE) {
+            ssize_t n = ::read(fd, chunk + length, RD_CHUNK_SIZE - length);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0)
+                ret = -errno;
+            if (n <= 0)
+                break;
+            length += n;
+        }
+        if (ret < 0 || length == 0)
+            break;
+
+        memset(chunk + length, 0, RD_CHUNK_SIZE - length);
+        this->size += length;
+        this->chunks.resize(c + 1, NULL);
+        for (ssize_t i = 0; i < length; i++) {
+            if (chunk[i] != 0) {
+                this->chunks[c] = chunk;
+                chunk = (char *) malloc(RD_CHUNK_SIZE);
+                break;
+            }
+        }
+        if (length < RD_CHUNK_SIZE)
+            break;
+    }
+    if (chunk == NULL && ret == 0)
+        ret = -ENOMEM;
+    free(chunk);
+    ::close(fd);
+
+    if (ret < 0)
+        freeChunks();
+    return ret;
+}
+
+int RamBlockDevice::create(const char *path, int flags) {
+    freeChunks();
+    return 0;
+}
+
+int RamBlockDevice::close() {
+    freeChunks();
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::readv(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
+    uint64_t offset = firstBlock * this->blockSize;
+
+    pthread_rwlock_rdlock(&this->chunkLock);
+    for (int i = 0; i < iovcnt; i++) {
+        char *buffer = (char *) iov[i].iov_base;
+        size_t length = iov[i].iov_len;
+        while (length > 0) {
+            size_t inChunk = offset % RD_CHUNK_SIZE;
+            size_t n = RD_CHUNK_SIZE - inChunk < length ? RD_CHUNK_SIZE - inChunk : length;
+            char *chunk = getChunk(offset / RD_CHUNK_SIZE, false);
+            if (chunk == NULL)
+                memset(buffer, 0, n);
+            else
+                memcpy(buffer, chunk + inChunk, n);
+            buffer += n;
+            offset += n;
+            length -= n;
+        }
+    }
+    pthread_rwlock_unlock(&this->chunkLock);
+
+    return 0;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::writev(uint64_t firstBlock, const struct iovec *iov, int iovcnt) {
+    uint64_t offset = firstBlock * this->blockSize;
+    int ret = 0;
+
+    pthread_rwlock_wrlock(&this->chunkLock);
+    for (int i = 0; i < iovcnt && ret == 0; i++) {
+        const char *buffer = (const char *) iov[i].iov_base;
+        size_t length = iov[i].iov_len;
+        while (length > 0) {
+            size_t inChunk = offset % RD_CHUNK_SIZE;
+            size_t n = RD_CHUNK_SIZE - inChunk < length ? RD_CHUNK_SIZE - inChunk : length;
+            char *chunk = getChunk(offset / RD_CHUNK_SIZE, true);
+            if (chunk == NULL) {
+                ret = -ENOMEM;
+                break;
+            }
+            memcpy(chunk + inChunk, buffer, n);
+            buffer += n;
+            offset += n;
+            length -= n;
+        }
+        if (offset > this->size)
+            this->size = offset;
+    }
+    pthread_rwlock_unlock(&this->chunkLock);
+
+    return ret;
+}
+
+int RamBlockDevice::map() {
+    this->mapped = true;
+    return 0;
+}
+
+int RamBlockDevice::unmap() {
+    this->mapped = false;
+    return 0;
+}
+
+char *RamBlockDevice::getBlockPointer(uint64_t blockNo) {
+    uint64_t offset = blockNo * this->blockSize;
+    char *chunk;
+
+    if (!this->mapped)
+        return NULL;
+
+    pthread_rwlock_rdlock(&this->chunkLock);
+    if (offset + this->blockSize > this->size) {
+        pthread_rwlock_unlock(&this->chunkLock);
+        return NULL;
+    }
+    chunk = getChunk(offset / RD_CHUNK_SIZE, false);
+    pthread_rwlock_unlock(&this->chunkLock);
+
+    if (chunk == NULL) {
+        pthread_rwlock_wrlock(&this->chunkLock);
+        chunk = getChunk(offset / RD_CHUNK_SIZE, true);
+        pthread_rwlock_unlock(&this->chunkLock);
+        if (chunk == NULL)
+            return NULL;
+    }
+    return chunk + offset % RD_CHUNK_SIZE;
+}
+
+// this method returns 0 if successful, -errno otherwise
+int RamBlockDevice::discard(uint64_t firstBlock, uint64_t count) {
+    uint64_t offset = firstBlock * this->blockSize;
+    uint64_t end = offset + count * this->blockSize;
+
+    pthread_rwlock_wrlock(&this->chunkLock);
+    if (end > this->size)
+        end = this->size;
+    while (offset < end) {
+        size_t c = offset / RD_CHUNK_SIZE;
+        size_t inChunk = offset % RD_CHUNK_SIZE;
+        size_t n = RD_CHUNK_SIZE - inChunk < end - offset ? RD_CHUNK_SIZE - inChunk : end - offset;
+        char *chunk = getChunk(c, false);
+        // a mapped chunk stays allocated, pointers into it must remain valid
+        if (chunk != NULL && n == RD_CHUNK_SIZE && !this->mapped) {
+            free(chunk);
+            this->chunks[c] = NULL;
+        } else if (chunk != NULL) {
+            memset(chunk + inChunk, 0, n);
+        }
+        offset += n;
+    }
+    pthread_rwlock_unlock(&this->chunkLock);
+
+    return 0;
+}
+
+uint64_t RamBlockDevice::getSize() {
+    pthread_rwlock_rdlock(&this->chunkLock);
+    uint64_t size = this->size;
+    pthread_rwlock_unlock(&this->chunkLock);
+    return size;
+}
@@ -6,8 +6,12 @@
 //  Copyright © 2017 Oliver Waldhorst. All rights reserved.
 //
 
+#include <cstdio>
 #include <cstdlib>
+#include <libgen.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "catch.hpp"
 #include "helper.hpp"
@@ -46,4 +50,28 @@ void bdWriteRead(BlockDevice *bd, int noBlocks) {
     delete [] w;
 }
 
+void makeContainer(const char *directory, const char *content, size_t size) {
+    // mkfs.myfs is built into the directory of the unittests
+    char binary[4096];
+    ssize_t length = readlink("/proc/self/exe", binary, sizeof(binary) - 1);
+    REQUIRE(length > 0);
+    binary[length] = '\0';
+
+    mkdir(directory, 0755);
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/seed.bin", directory);
+    FILE *seed = fopen(path, "w");
+    REQUIRE(seed != NULL);
+    REQUIRE(fwrite(content, 1, size, seed) == size);
+    fclose(seed);
+    snprintf(path, sizeof(path), "%s/container.bin", directory);
+    unlink(path);
+
+    // mkfs.myfs creates container.bin in the current directory
+    char command[8192];
+    snprintf(command, sizeof(command), "cd '%s' && '%s/mkfs.myfs' container.bin seed.bin > /dev/null", directory,
+             dirname(binary));
+    REQUIRE(system(command) == 0);
+}
+
 // TODO: Implement you helper functions here
@@ -13,5 +13,7 @@
 
 void gen_random(char *s, const int len);
 void bdWriteRead(BlockDevice *bd, int noBlocks= 1);
+// creates directory/container.bin with the mkfs.myfs next to the unittests, holding the file seed.bin of content
+void makeContainer(const char *directory, const char *content, size_t size);
 
 #endif /* helper_hpp */
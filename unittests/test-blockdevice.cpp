@@ -10,10 +10,15 @@
 
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <thread>
+#include <vector>
 
 #include "helper.hpp"
 
+#include "blockcache.h"
 #include "blockdevice.h"
+#include "ramblockdevice.h"
 
 #define BD_PATH "/tmp/bd.bin"
 #define NUM_TESTBLOCKS 1024
@@ -76,4 +81,533 @@ TEST_CASE( "BD_OPEN_NON-EXISTING_FILE", "[blockdevice]" ) {
 
     BlockDevice bd;
     REQUIRE(bd.open(BD_PATH) < 0);
-}
\ No newline at end of file
+}
+TEST_CASE( "BD_READ_WRITE_MULTIPLE_BLOCKS", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+
+    SECTION("read blocks with a single request") {
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    SECTION("read blocks written one by one") {
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(bd.write(b, w + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    SECTION("scatter read into separate buffers") {
+        struct iovec iov[3];
+        iov[0].iov_base = r + BD_BLOCK_SIZE * 10;
+        iov[0].iov_len = BD_BLOCK_SIZE;
+        iov[1].iov_base = r;
+        iov[1].iov_len = BD_BLOCK_SIZE * 10;
+        iov[2].iov_base = r + BD_BLOCK_SIZE * 11;
+        iov[2].iov_len = BD_BLOCK_SIZE * 2;
+        REQUIRE(bd.readv(5, iov, 3) == 0);
+        REQUIRE(memcmp(r + BD_BLOCK_SIZE * 10, w + BD_BLOCK_SIZE * 5, BD_BLOCK_SIZE) == 0);
+        REQUIRE(memcmp(r, w + BD_BLOCK_SIZE * 6, BD_BLOCK_SIZE * 10) == 0);
+        REQUIRE(memcmp(r + BD_BLOCK_SIZE * 11, w + BD_BLOCK_SIZE * 16, BD_BLOCK_SIZE * 2) == 0);
+    }
+
+    SECTION("blocks behind the end of the container are zero filled") {
+        memset(r, 1, BD_BLOCK_SIZE * 4);
+        REQUIRE(bd.readBlocks(NUM_TESTBLOCKS - 2, 4, r) == 0);
+        REQUIRE(memcmp(r, w + BD_BLOCK_SIZE * (NUM_TESTBLOCKS - 2), BD_BLOCK_SIZE * 2) == 0);
+        for(int i= BD_BLOCK_SIZE * 2; i < BD_BLOCK_SIZE * 4; i++) {
+            REQUIRE(r[i] == 0);
+        }
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_CONCURRENT_READ_WRITE", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    const int numThreads = 4;
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    // every thread writes and reads back an interleaved share of the blocks
+    std::vector<int> results(numThreads, 0);
+    std::vector<std::thread> threads;
+    for(int t= 0; t < numThreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            for(int b= t; b < NUM_TESTBLOCKS && results[t] == 0; b += numThreads) {
+                results[t] = bd.write(b, w + b*BD_BLOCK_SIZE);
+            }
+            for(int b= t; b < NUM_TESTBLOCKS && results[t] == 0; b += numThreads) {
+                results[t] = bd.read(b, r + b*BD_BLOCK_SIZE);
+            }
+        }));
+    }
+    for(int t= 0; t < numThreads; t++) {
+        threads[t].join();
+        REQUIRE(results[t] == 0);
+    }
+
+    REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_MAPPED_CONTAINER", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.map() == 0);
+    REQUIRE(bd.getBlockPointer(0) == NULL);
+
+    SECTION("write and read through the mapping") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+    }
+
+    SECTION("block pointers show written blocks") {
+        char w[BD_BLOCK_SIZE];
+        gen_random(w, BD_BLOCK_SIZE);
+        REQUIRE(bd.write(3, w) == 0);
+        REQUIRE(bd.getBlockPointer(3) != NULL);
+        REQUIRE(memcmp(bd.getBlockPointer(3), w, BD_BLOCK_SIZE) == 0);
+        REQUIRE(bd.getBlockPointer(BD_MAP_GROW_SIZE / BD_BLOCK_SIZE) == NULL);
+    }
+
+    SECTION("blocks are read ahead inside and behind the mapping") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+        REQUIRE(bd.willNeed(1, NUM_TESTBLOCKS - 1) == 0);
+        REQUIRE(bd.willNeed(BD_MAP_GROW_SIZE / BD_BLOCK_SIZE, 8) == 0);
+        REQUIRE(bd.unmap() == 0);
+        REQUIRE(bd.willNeed(1, NUM_TESTBLOCKS - 1) == 0);
+    }
+
+    SECTION("mapped blocks reach the container file") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+        char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(bd.sync() == 0);
+        REQUIRE(bd.close() == 0);
+
+        BlockDevice bd2;
+        char* r2= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+        REQUIRE(bd2.open(BD_PATH) == 0);
+        REQUIRE(bd2.readBlocks(0, NUM_TESTBLOCKS, r2) == 0);
+        REQUIRE(memcmp(r, r2, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        REQUIRE(bd2.map() == 0);
+        REQUIRE(bd2.getBlockPointer(NUM_TESTBLOCKS - 1) != NULL);
+        REQUIRE(memcmp(bd2.getBlockPointer(0), r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        delete [] r;
+        delete [] r2;
+        REQUIRE(bd2.close() == 0);
+        REQUIRE(bd.open(BD_PATH) == 0);
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_BATCH_SUBMIT", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    SECTION("positional I/O or io_uring") {
+    }
+
+    SECTION("mapped container") {
+        REQUIRE(bd.map() == 0);
+    }
+
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    // more requests than the submission queue holds, every second block written in reverse order
+    BlockBatch batch;
+    for(int b= NUM_TESTBLOCKS - 2; b >= 0; b -= 2) {
+        batch.queueWrite(b, 1, w + b*BD_BLOCK_SIZE);
+    }
+    REQUIRE(batch.size() == NUM_TESTBLOCKS / 2);
+    REQUIRE(bd.submit(&batch) == 0);
+    REQUIRE(batch.size() == 0);
+
+    batch.queueWrite(1, 1, w + BD_BLOCK_SIZE);
+    struct iovec iov[2];
+    iov[0].iov_base = w + BD_BLOCK_SIZE * 3;
+    iov[0].iov_len = BD_BLOCK_SIZE;
+    iov[1].iov_base = w + BD_BLOCK_SIZE * 5;
+    iov[1].iov_len = BD_BLOCK_SIZE;
+    batch.queueWritev(3, iov, 1);
+    batch.queueWritev(5, iov + 1, 1);
+    for(int b= 7; b < NUM_TESTBLOCKS; b += 2) {
+        batch.queueWrite(b, 1, w + b*BD_BLOCK_SIZE);
+    }
+    REQUIRE(bd.submit(&batch) == 0);
+
+    batch.queueRead(0, NUM_TESTBLOCKS / 2, r);
+    batch.queueRead(NUM_TESTBLOCKS / 2, NUM_TESTBLOCKS / 2, r + BD_BLOCK_SIZE * (NUM_TESTBLOCKS / 2));
+    REQUIRE(bd.submit(&batch) == 0);
+    REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+
+    // reads behind the end of the container are zero filled
+    memset(r, 1, BD_BLOCK_SIZE * 2);
+    batch.queueRead(NUM_TESTBLOCKS + 100, 2, r);
+    REQUIRE(bd.submit(&batch) == 0);
+    for(int i= 0; i < BD_BLOCK_SIZE * 2; i++) {
+        REQUIRE(r[i] == 0);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_DIRECT_IO", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH, BD_DIRECT_IO) == 0);
+
+    SECTION("unaligned single blocks are bounced") {
+        bdWriteRead(&bd, NUM_TESTBLOCKS);
+    }
+
+    SECTION("aligned buffers are transferred directly") {
+        AlignedBufferPool pool;
+        char *w = pool.get();
+        char *r = pool.get();
+        REQUIRE(w != NULL);
+        REQUIRE(r != NULL);
+        REQUIRE((uintptr_t) w % BD_DIRECT_ALIGNMENT == 0);
+        gen_random(w, BD_DIRECT_BUFFER_SIZE);
+        memset(r, 0, BD_DIRECT_BUFFER_SIZE);
+
+        REQUIRE(bd.writeBlocks(8, BD_DIRECT_BUFFER_SIZE / BD_BLOCK_SIZE, w) == 0);
+        REQUIRE(bd.readBlocks(8, BD_DIRECT_BUFFER_SIZE / BD_BLOCK_SIZE, r) == 0);
+        REQUIRE(memcmp(w, r, BD_DIRECT_BUFFER_SIZE) == 0);
+
+        // unaligned access to the same blocks sees the same content
+        char b[BD_BLOCK_SIZE * 3];
+        REQUIRE(bd.readBlocks(9, 3, b) == 0);
+        REQUIRE(memcmp(b, w + BD_BLOCK_SIZE, BD_BLOCK_SIZE * 3) == 0);
+
+        pool.put(w);
+        pool.put(r);
+    }
+
+    SECTION("aligned writes do not land inside the read-modify-write of a partial sector") {
+        AlignedBufferPool pool;
+        char *w = pool.get();
+        REQUIRE(w != NULL);
+        const int sectorBlocks = BD_DIRECT_ALIGNMENT / BD_BLOCK_SIZE;
+        const int rounds = 200;
+        int alignedResult = 0;
+        int partialResult = 0;
+        std::thread aligned([&]() {
+            for (int k = 1; k <= rounds && alignedResult == 0; k++) {
+                memset(w, k, BD_DIRECT_ALIGNMENT);
+                alignedResult = bd.writeBlocks(0, sectorBlocks, w);
+            }
+        });
+        std::thread partial([&]() {
+            char b[BD_BLOCK_SIZE];
+            memset(b, 'x', BD_BLOCK_SIZE);
+            for (int k = 1; k <= rounds && partialResult == 0; k++) {
+                partialResult = bd.write(1, b);
+            }
+        });
+        aligned.join();
+        partial.join();
+        REQUIRE(alignedResult == 0);
+        REQUIRE(partialResult == 0);
+
+        // all blocks of the sector but the partially written one hold the last aligned write
+        char r[BD_DIRECT_ALIGNMENT];
+        REQUIRE(bd.readBlocks(0, sectorBlocks, r) == 0);
+        int stale = 0;
+        for (int i = 0; i < BD_DIRECT_ALIGNMENT; i++) {
+            if (i / BD_BLOCK_SIZE != 1 && r[i] != (char) rounds)
+                stale++;
+        }
+        REQUIRE(stale == 0);
+
+        pool.put(w);
+    }
+
+    SECTION("a direct container cannot be mapped") {
+        if (bd.isDirect()) {
+            REQUIRE(bd.map() < 0);
+        }
+    }
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_BLOCKS_BEYOND_4_GIB", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    // the container stays sparse, only the written blocks use space
+    const uint64_t farBlock = (5ULL * 1024 * 1024 * 1024) / BD_BLOCK_SIZE;
+    char w[BD_BLOCK_SIZE * 2];
+    char r[BD_BLOCK_SIZE * 2];
+    gen_random(w, BD_BLOCK_SIZE * 2);
+
+    REQUIRE(bd.writeBlocks(farBlock, 2, w) == 0);
+    REQUIRE(bd.getSize() == (farBlock + 2) * BD_BLOCK_SIZE);
+    REQUIRE(bd.readBlocks(farBlock, 2, r) == 0);
+    REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 2) == 0);
+
+    // blocks at the same offset modulo 4 GiB are not touched
+    REQUIRE(bd.read(farBlock - (4ULL * 1024 * 1024 * 1024) / BD_BLOCK_SIZE, r) == 0);
+    for(int i= 0; i < BD_BLOCK_SIZE; i++) {
+        REQUIRE(r[i] == 0);
+    }
+
+    REQUIRE(bd.close() == 0);
+
+    BlockDevice bd2;
+    REQUIRE(bd2.open(BD_PATH) == 0);
+    REQUIRE(bd2.getSize() == (farBlock + 2) * BD_BLOCK_SIZE);
+    REQUIRE(bd2.read(farBlock + 1, r) == 0);
+    REQUIRE(memcmp(w + BD_BLOCK_SIZE, r, BD_BLOCK_SIZE) == 0);
+    REQUIRE(bd2.close() == 0);
+
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BD_DISCARD", "[blockdevice]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* w= new char[BD_BLOCK_SIZE * 64];
+    char* r= new char[BD_BLOCK_SIZE * 64];
+    gen_random(w, BD_BLOCK_SIZE * 64);
+    REQUIRE(bd.writeBlocks(0, 64, w) == 0);
+
+    int ret= bd.discard(6, 20);
+    if(ret != -EOPNOTSUPP) {
+        REQUIRE(ret == 0);
+        REQUIRE(bd.readBlocks(0, 64, r) == 0);
+        // the whole 4 KiB units are released and the partial units around them are zeroed
+        REQUIRE(memcmp(r, w, BD_BLOCK_SIZE * 6) == 0);
+        for(int i= BD_BLOCK_SIZE * 6; i < BD_BLOCK_SIZE * 26; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(r + BD_BLOCK_SIZE * 26, w + BD_BLOCK_SIZE * 26, BD_BLOCK_SIZE * 38) == 0);
+        REQUIRE(bd.getSize() == BD_BLOCK_SIZE * 64);
+
+        // a range inside one unit is zeroed as well
+        REQUIRE(bd.discard(1, 2) == 0);
+        REQUIRE(bd.readBlocks(0, 4, r) == 0);
+        REQUIRE(memcmp(r, w, BD_BLOCK_SIZE) == 0);
+        for(int i= BD_BLOCK_SIZE; i < BD_BLOCK_SIZE * 3; i++) {
+            REQUIRE(r[i] == 0);
+        }
+        REQUIRE(memcmp(r + BD_BLOCK_SIZE * 3, w + BD_BLOCK_SIZE * 3, BD_BLOCK_SIZE) == 0);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
+
+TEST_CASE( "RD_LOAD_READ_WRITE", "[ramblockdevice]" ) {
+
+    remove(BD_PATH);
+
+    char* w= new char[BD_BLOCK_SIZE * 64];
+    char* r= new char[BD_BLOCK_SIZE * 64];
+    gen_random(w, BD_BLOCK_SIZE * 64);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+    REQUIRE(bd.writeBlocks(0, 64, w) == 0);
+    REQUIRE(bd.close() == 0);
+
+    RamBlockDevice rd;
+    REQUIRE(rd.open("/tmp/no-such-container.bin") == -ENOENT);
+    REQUIRE(rd.open(BD_PATH) == 0);
+    REQUIRE(rd.getSize() == BD_BLOCK_SIZE * 64);
+    REQUIRE(rd.readBlocks(0, 64, r) == 0);
+    REQUIRE(memcmp(r, w, BD_BLOCK_SIZE * 64) == 0);
+
+    // blocks behind the end read as zeros, writing them grows the device
+    REQUIRE(rd.read(4000, r) == 0);
+    for(int i= 0; i < BD_BLOCK_SIZE; i++) {
+        REQUIRE(r[i] == 0);
+    }
+    REQUIRE(rd.write(4000, w) == 0);
+    REQUIRE(rd.getSize() == (uint64_t) BD_BLOCK_SIZE * 4001);
+    REQUIRE(rd.read(4000, r) == 0);
+    REQUIRE(memcmp(r, w, BD_BLOCK_SIZE) == 0);
+
+    REQUIRE(rd.getBlockPointer(1) == NULL);
+    REQUIRE(rd.map() == 0);
+    REQUIRE(rd.getBlockPointer(4001) == NULL);
+    REQUIRE(memcmp(rd.getBlockPointer(1), w + BD_BLOCK_SIZE, BD_BLOCK_SIZE) == 0);
+    memcpy(rd.getBlockPointer(2), w, BD_BLOCK_SIZE);
+    REQUIRE(rd.read(2, r) == 0);
+    REQUIRE(memcmp(r, w, BD_BLOCK_SIZE) == 0);
+
+    REQUIRE(rd.discard(1, 2) == 0);
+    REQUIRE(rd.readBlocks(0, 4, r) == 0);
+    REQUIRE(memcmp(r, w, BD_BLOCK_SIZE) == 0);
+    for(int i= BD_BLOCK_SIZE; i < BD_BLOCK_SIZE * 3; i++) {
+        REQUIRE(r[i] == 0);
+    }
+    REQUIRE(memcmp(r + BD_BLOCK_SIZE * 3, w + BD_BLOCK_SIZE * 3, BD_BLOCK_SIZE) == 0);
+    REQUIRE(rd.close() == 0);
+
+    // the container file is never written
+    REQUIRE(bd.open(BD_PATH) == 0);
+    REQUIRE(bd.readBlocks(0, 64, r) == 0);
+    REQUIRE(memcmp(r, w, BD_BLOCK_SIZE * 64) == 0);
+    REQUIRE(bd.close() == 0);
+
+    delete [] r;
+    delete [] w;
+
+    remove(BD_PATH);
+}
+
+TEST_CASE( "BC_READ_WRITE_BACK", "[blockcache]" ) {
+
+    remove(BD_PATH);
+
+    BlockDevice bd;
+    REQUIRE(bd.create(BD_PATH) == 0);
+
+    char* w= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    char* r= new char[BD_BLOCK_SIZE * NUM_TESTBLOCKS];
+    gen_random(w, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+    memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+
+    SECTION("written blocks reach the block device on flush") {
+        BlockCache cache(&bd, BD_BLOCK_SIZE, BD_BLOCK_SIZE * 64);
+        REQUIRE(cache.writeBlocks(0, 32, w) == 0);
+        REQUIRE(bd.readBlocks(0, 32, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 32) != 0);
+        REQUIRE(cache.readBlocks(0, 32, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 32) == 0);
+        REQUIRE(cache.getHits() == 32);
+        REQUIRE(cache.flush() == 0);
+        REQUIRE(cache.getWriteBacks() == 32);
+        REQUIRE(bd.readBlocks(0, 32, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 32) == 0);
+    }
+
+    SECTION("dirty blocks are written back when they are evicted") {
+        BlockCache cache(&bd, BD_BLOCK_SIZE, BD_BLOCK_SIZE * 64);
+        for(int b= 0; b < NUM_TESTBLOCKS; b++) {
+            REQUIRE(cache.write(b, w + b*BD_BLOCK_SIZE) == 0);
+        }
+        REQUIRE(cache.getWriteBacks() > 0);
+        REQUIRE(cache.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+        REQUIRE(cache.flush() == 0);
+        memset(r, 0, BD_BLOCK_SIZE * NUM_TESTBLOCKS);
+        REQUIRE(bd.readBlocks(0, NUM_TESTBLOCKS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * NUM_TESTBLOCKS) == 0);
+    }
+
+    SECTION("evicting a dirty block writes back a bounded batch, not the whole cache") {
+        BlockCache cache(&bd, BD_BLOCK_SIZE, BD_BLOCK_SIZE * 512);
+        REQUIRE(cache.writeBlocks(0, 512, w) == 0);
+        REQUIRE(cache.getWriteBacks() == 0);
+        REQUIRE(cache.write(512, w + BD_BLOCK_SIZE * 512) == 0);
+        REQUIRE(cache.getWriteBacks() == BC_EVICT_WRITE_BACK_SLOTS);
+        REQUIRE(bd.readBlocks(0, BC_EVICT_WRITE_BACK_SLOTS, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * BC_EVICT_WRITE_BACK_SLOTS) == 0);
+        REQUIRE(!cache.contains(0));
+        REQUIRE(cache.contains(1));
+
+        // the blocks written back are replaced next without another write back
+        REQUIRE(cache.write(513, w + BD_BLOCK_SIZE * 513) == 0);
+        REQUIRE(cache.getWriteBacks() == BC_EVICT_WRITE_BACK_SLOTS);
+        REQUIRE(cache.flush() == 0);
+        REQUIRE(cache.getWriteBacks() == 514);
+        REQUIRE(bd.readBlocks(0, 514, r) == 0);
+        REQUIRE(memcmp(w, r, BD_BLOCK_SIZE * 514) == 0);
+    }
+
+    SECTION("misses are read from the block device and counted") {
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        BlockCache cache(&bd, BD_BLOCK_SIZE, BD_BLOCK_SIZE * 64);
+        uint64_t blocks[3] = {7, 3, 4};
+        char* buffers[3] = {r, r + BD_BLOCK_SIZE, r + BD_BLOCK_SIZE * 2};
+        REQUIRE(cache.readBlocks(blocks, buffers, 3) == 0);
+        REQUIRE(memcmp(r, w + BD_BLOCK_SIZE * 7, BD_BLOCK_SIZE) == 0);
+        REQUIRE(memcmp(r + BD_BLOCK_SIZE, w + BD_BLOCK_SIZE * 3, BD_BLOCK_SIZE * 2) == 0);
+        REQUIRE(cache.getMisses() == 3);
+        REQUIRE(cache.contains(3));
+        REQUIRE(cache.read(7, r) == 0);
+        REQUIRE(cache.getHits() == 1);
+    }
+
+    SECTION("prefetched blocks are served from the cache") {
+        REQUIRE(bd.writeBlocks(0, NUM_TESTBLOCKS, w) == 0);
+        BlockCache cache(&bd, BD_BLOCK_SIZE, BD_BLOCK_SIZE * 64);
+        uint64_t blocks[8] = {10, 11, 12, 13, 20, 21, 22, 23};
+        REQUIRE(cache.prefetch(blocks, 8) == 0);
+        REQUIRE(cache.getPrefetched() == 8);
+        REQUIRE(cache.readBlocks(20, 4, r) == 0);
+        REQUIRE(memcmp(r, w + BD_BLOCK_SIZE * 20, BD_BLOCK_SIZE * 4) == 0);
+        REQUIRE(cache.getHits() == 4);
+        REQUIRE(cache.getMisses() == 0);
+        REQUIRE(cache.write(12, w) == 0);
+        REQUIRE(cache.prefetch(blocks, 8) == 0);
+        REQUIRE(cache.read(12, r) == 0);
+        REQUIRE(memcmp(r, w, BD_BLOCK_SIZE) == 0);
+        cache.prefetchAsync(blocks, 4);
+    }
+
+    delete [] r;
+    delete [] w;
+
+    REQUIRE(bd.close() == 0);
+    remove(BD_PATH);
+}
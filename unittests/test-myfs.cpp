@@ -8,8 +8,564 @@
 
 #include "catch.hpp"
 
+#include <string.h>
+
 
 #include "helper.hpp"
 #include "myfs.h"
 
 // TODO: Implement your helper functions here!
+
+TEST_CASE( "DMAP_USED_FREE_RUNS", "[dmap]" ) {
+
+    DMap *dMap = new DMap();
+    unsigned int length;
+    REQUIRE(dMap->getFreeCount() == D_Map_SIZE);
+    REQUIRE(dMap->findNextFreeRun(0, &length) == 0);
+    REQUIRE(length == D_Map_SIZE);
+
+    for (unsigned int i = 0; i < 100; i++) {
+        dMap->setUsed(i);
+    }
+    REQUIRE(dMap->getFreeCount() == D_Map_SIZE - 100);
+    REQUIRE(dMap->isUsed(99));
+    REQUIRE(!dMap->isUsed(100));
+    REQUIRE(dMap->findNextFreeRun(0, &length) == 100);
+    dMap->setFree(10);
+    REQUIRE(dMap->findNextFreeRun(0, &length) == 10);
+    REQUIRE(length == 1);
+
+    // fill all but two separated blocks, the search skips full words
+    for (unsigned int i = 100; i < D_Map_SIZE; i++) {
+        dMap->setUsed(i);
+    }
+    dMap->setFree(5000);
+    REQUIRE(dMap->getFreeCount() == 2);
+    REQUIRE(dMap->findNextFreeRun(11, &length) == 5000);
+    REQUIRE(length == 1);
+    dMap->setUsed(10);
+    dMap->setUsed(5000);
+    REQUIRE(dMap->findNextFreeRun(0, &length) == -1);
+    REQUIRE(dMap->getFreeCount() == 0);
+
+    // a run across word boundaries behind used blocks
+    for (unsigned int i = 1000; i < 1300; i++) {
+        dMap->setFree(i);
+    }
+    dMap->setFree(200);
+    REQUIRE(dMap->findNextFreeRun(201, &length) == 1000);
+    REQUIRE(length == 300);
+
+    // the summary and the free count are rebuilt from the stored bitmap
+    DMap *loaded = new DMap();
+    memcpy(loaded->getData(), dMap->getData(), D_MAP_BYTES);
+    loaded->load();
+    REQUIRE(loaded->getFreeCount() == 301);
+    REQUIRE(loaded->findNextFreeRun(0, &length) == 200);
+    REQUIRE(loaded->findNextFreeRun(201, &length) == 1000);
+    REQUIRE(length == 300);
+
+    delete loaded;
+    delete dMap;
+}
+
+TEST_CASE( "MYFILE_EXTENTS", "[myfile]" ) {
+
+    MyFile file;
+    int blocks[8];
+    file.clearExtents();
+    REQUIRE(file.hasExtents());
+    REQUIRE(file.findDataBlocks(0, 1, blocks) == 0);
+
+    // following data blocks extend the last extent
+    file.appendExtent(100, 3);
+    file.appendExtent(103, 2);
+    file.appendExtent(50, 2);
+    REQUIRE(file.getExtentCount() == 2);
+    REQUIRE(file.getExtentBlocks() == 7);
+    REQUIRE(file.findDataBlocks(3, 8, blocks) == 4);
+    REQUIRE(blocks[0] == 103);
+    REQUIRE(blocks[1] == 104);
+    REQUIRE(blocks[2] == 50);
+    REQUIRE(blocks[3] == 51);
+
+    file.truncateExtents(4);
+    REQUIRE(file.getExtentCount() == 1);
+    REQUIRE(file.getExtentBlocks() == 4);
+    REQUIRE(file.findDataBlocks(4, 1, blocks) == 0);
+
+    // a file with too many extents is described by its fat chain only
+    for (int i = 0; i < FILE_EXTENTS; i++) {
+        file.appendExtent(1000 + 2 * i, 1);
+    }
+    REQUIRE(!file.hasExtents());
+    REQUIRE(file.getExtentBlocks() == 0);
+}
+
+TEST_CASE( "SUPER_BLOCK_AND_INODE_ENCODING", "[diskformat]" ) {
+
+    char frame[BLOCK_SIZE];
+    SuperBlock superBlock(4096);
+    superBlock.setInodeCount(70000);
+    superBlock.setFreeInode(-1);
+    superBlock.setUsedSize(5000000000ul);
+    superBlock.setJournalSequence(0x0102030405060708ull);
+    superBlock.encode(frame);
+
+    // the fields are stored little-endian behind the magic number and the format version
+    REQUIRE(memcmp(frame, "MYFS", 4) == 0);
+    REQUIRE(frame[4] == FORMAT_VERSION);
+    REQUIRE(frame[44] == 0x08);
+    REQUIRE(frame[51] == 0x01);
+
+    SuperBlock decoded;
+    REQUIRE(decoded.decode(frame) == 0);
+    REQUIRE(decoded.getFormatVersion() == FORMAT_VERSION);
+    REQUIRE(decoded.getBlockSize() == 4096);
+    REQUIRE(decoded.getDataBlockIndexStart() == superBlock.getDataBlockIndexStart());
+    REQUIRE(decoded.getInodeCount() == 70000);
+    REQUIRE(decoded.getFreeInode() == -1);
+    REQUIRE(decoded.getUsedSize() == 5000000000ul);
+    REQUIRE(decoded.getJournalSequence() == 0x0102030405060708ull);
+    REQUIRE(decoded.getInodeSize() == INODE_SIZE);
+
+    // a newer format version or a frame without the magic number is refused
+    frame[4] = FORMAT_VERSION + 1;
+    REQUIRE(decoded.decode(frame) == -EINVAL);
+    memset(frame, 0, BLOCK_SIZE);
+    REQUIRE(decoded.decode(frame) == -EINVAL);
+
+    char record[INODE_SIZE];
+    MyFile file;
+    file.clearExtents();
+    file.setFileSize(3000);
+    file.setMode(S_IFREG | 0644);
+    file.setMTime((time_t) 1700000000);
+    file.setParentIndex(ROOT_DIRECTORY);
+    file.setFirstDataBlockIndex(100);
+    file.setOpenIndex(5);
+    file.appendExtent(100, 3);
+    file.appendExtent(50, 3);
+    file.encode(record);
+
+    MyFile loaded;
+    int blocks[6];
+    loaded.decode(record, FORMAT_VERSION);
+    REQUIRE(loaded.getFileSize() == 3000);
+    REQUIRE(loaded.getMode() == (S_IFREG | 0644));
+    REQUIRE(loaded.getMTime() == (time_t) 1700000000);
+    REQUIRE(loaded.getParentIndex() == ROOT_DIRECTORY);
+    REQUIRE(loaded.getFirstDataBlockIndex() == 100);
+    REQUIRE(loaded.getOpenIndex() == -1);
+    REQUIRE(loaded.getExtentCount() == 2);
+    REQUIRE(loaded.findDataBlocks(0, 6, blocks) == 6);
+    REQUIRE(blocks[2] == 102);
+    REQUIRE(blocks[3] == 50);
+    REQUIRE(!loaded.hasInlineData());
+
+    // a small file keeps its content in place of its extents, the first format version has no inline data
+    MyFile small;
+    small.clearExtents();
+    small.setFileSize(5);
+    small.setInlineData("hello", 5);
+    small.encode(record);
+    loaded.decode(record, FORMAT_VERSION);
+    REQUIRE(loaded.hasInlineData());
+    REQUIRE(loaded.getExtentCount() == 0);
+    REQUIRE(memcmp(loaded.getInlineData(), "hello", 5) == 0);
+    loaded.decode(record, 1);
+    REQUIRE(!loaded.hasInlineData());
+}
+
+TEST_CASE( "FREE_EXTENTS_ASSIGN_RELEASE", "[freeextents]" ) {
+
+    DMap *dMap = new DMap();
+    for (unsigned int i = 0; i < 1000; i++) {
+        dMap->setUsed(i);
+    }
+    dMap->setFree(100);
+    dMap->setFree(101);
+    for (unsigned int i = 500; i < 510; i++) {
+        dMap->setFree(i);
+    }
+    FreeExtents extents;
+    extents.load(dMap);
+    REQUIRE(extents.getExtentCount() == 3);
+    REQUIRE(extents.getFreeCount() == D_Map_SIZE - 1000 + 12);
+    unsigned int first, count;
+    REQUIRE(extents.find(505, &first, &count));
+    REQUIRE(first == 500);
+    REQUIRE(count == 10);
+    REQUIRE(!extents.find(510, &first, &count));
+    REQUIRE(!extents.find(99, &first, &count));
+
+    // the best fitting free extent is taken without a goal
+    int blocks[64];
+    REQUIRE(extents.assign(8, -1, blocks));
+    REQUIRE(blocks[0] == 500);
+    REQUIRE(blocks[7] == 507);
+
+    // an append continues at its goal and then in a free extent close behind it
+    REQUIRE(extents.assign(4, 508, blocks));
+    REQUIRE(blocks[0] == 508);
+    REQUIRE(blocks[1] == 509);
+    REQUIRE(blocks[2] == 1000);
+    REQUIRE(blocks[3] == 1001);
+
+    // released blocks are merged with their neighbours
+    extents.release(508, 2);
+    extents.release(500, 8);
+    REQUIRE(extents.getExtentCount() == 3);
+    REQUIRE(extents.assign(10, -1, blocks));
+    REQUIRE(blocks[0] == 500);
+    REQUIRE(blocks[9] == 509);
+
+    REQUIRE(!extents.assign(D_Map_SIZE, -1, blocks));
+    delete dMap;
+}
+
+TEST_CASE( "JOURNAL_COMMIT_REPLAY", "[journal]" ) {
+
+    RamBlockDevice rd(BLOCK_SIZE);
+    REQUIRE(rd.create("/tmp/journal-container.bin") == 0);
+
+    char *w = new char[BLOCK_SIZE * 3];
+    char *r = new char[BLOCK_SIZE * 3];
+    gen_random(w, BLOCK_SIZE * 3);
+    uint64_t blocks[] = {0, 5, 9};
+    char *buffers[] = {w, w + BLOCK_SIZE, w + 2 * BLOCK_SIZE};
+
+    // home blocks 0 to 9, the journal region starts at block 10
+    Journal journal(&rd, BLOCK_SIZE, 10, 12, 10);
+    REQUIRE(!journal.isFull());
+    REQUIRE(journal.commit(blocks, buffers, 3) == 0);
+    REQUIRE(journal.commit(blocks + 1, buffers, 1) == 0);
+    REQUIRE(journal.getSequence() == 3);
+    REQUIRE(journal.isFull());
+
+    // the descriptor is little-endian, the home block numbers follow the header
+    REQUIRE(rd.read(10, r) == 0);
+    REQUIRE(memcmp(r, "LJYM\3\0\0\0\1\0\0\0\0\0\0\0", 16) == 0);
+    REQUIRE(memcmp(r + JOURNAL_HEADER_SIZE + 8, "\5\0\0\0\0\0\0\0\11\0\0\0\0\0\0\0", 16) == 0);
+
+    // the home blocks are written by the replay, the later transaction wins
+    REQUIRE(rd.read(5, r) == 0);
+    REQUIRE(r[0] == 0);
+    Journal mounted(&rd, BLOCK_SIZE, 10, 12, 10);
+    REQUIRE(mounted.replay(1) == 2);
+    REQUIRE(mounted.getSequence() == 3);
+    REQUIRE(rd.read(0, r) == 0);
+    REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    REQUIRE(rd.read(5, r) == 0);
+    REQUIRE(memcmp(r, w, BLOCK_SIZE) == 0);
+    REQUIRE(rd.read(9, r) == 0);
+    REQUIRE(memcmp(r, w + 2 * BLOCK_SIZE, BLOCK_SIZE) == 0);
+
+    // transactions of an earlier pass are not replayed
+    REQUIRE(mounted.replay(3) == 0);
+
+    // a torn transaction is not replayed
+    mounted.reset(3);
+    REQUIRE(mounted.commit(blocks + 2, buffers, 1) == 0);
+    REQUIRE(rd.read(11, r) == 0);
+    r[0] ^= 1;
+    REQUIRE(rd.write(11, r) == 0);
+    REQUIRE(mounted.replay(3) == 0);
+
+    // home blocks may lie behind the journal region, a large transaction needs two descriptor blocks
+    uint64_t farBlocks[70];
+    char *farBuffers[70];
+    for (int i = 0; i < 70; i++) {
+        farBlocks[i] = 100 + 69 - i;
+        farBuffers[i] = w + (i % 3) * BLOCK_SIZE;
+    }
+    REQUIRE(Journal::getDescriptorBlocks(BLOCK_SIZE, 70) == 2);
+    Journal large(&rd, BLOCK_SIZE, 20, 72, 70);
+    REQUIRE(large.commit(farBlocks, farBuffers, 71) == -ENOSPC);
+    REQUIRE(large.commit(farBlocks, farBuffers, 70) == 0);
+    Journal largeMounted(&rd, BLOCK_SIZE, 20, 72, 70);
+    REQUIRE(largeMounted.replay(1) == 1);
+    for (int i = 0; i < 70; i++) {
+        REQUIRE(rd.read(farBlocks[i], r) == 0);
+        REQUIRE(memcmp(r, farBuffers[i], BLOCK_SIZE) == 0);
+    }
+
+    delete[] w;
+    delete[] r;
+}
+
+TEST_CASE( "DIRECTORY_BLOCK_INSERT_FIND_REMOVE", "[directory]" ) {
+
+    char *data = new char[BLOCK_SIZE];
+    DirectoryBlock block(data, BLOCK_SIZE);
+    block.clear();
+    REQUIRE(block.getCount() == 0);
+
+    // entries are packed until the block is full
+    char name[32];
+    int inserted = 0;
+    while (true) {
+        sprintf(name, "entry-%d", inserted);
+        if (!block.insert(name, strlen(name), inserted)) {
+            break;
+        }
+        inserted++;
+    }
+    REQUIRE(inserted > 30);
+    REQUIRE(block.getCount() == (unsigned int) inserted);
+    REQUIRE(block.find("entry-7", 7) == 7);
+    REQUIRE(block.find("entry-7x", 7) == 7);
+    REQUIRE(block.find("entry-", 6) == -1);
+
+    // the header and the root indexes are little-endian
+    REQUIRE((unsigned char) data[0] == inserted);
+    REQUIRE(memcmp(data + 1, "\0\0\0", 3) == 0);
+    REQUIRE(memcmp(data + DIRECTORY_HEADER_SIZE + 5 + 7, "\1\0\0\0\7entry-1", 12) == 0);
+
+    // removing closes the gap, the following entries stay reachable
+    REQUIRE(block.remove("entry-3", 7));
+    REQUIRE(!block.remove("entry-3", 7));
+    REQUIRE(block.find("entry-3", 7) == -1);
+    REQUIRE(block.find("entry-4", 7) == 4);
+    REQUIRE(block.insert("x", 1, 100));
+
+    unsigned int offset = 0;
+    int rootIndex;
+    const char *entryName;
+    size_t length;
+    unsigned int count = 0;
+    while (block.next(&offset, &rootIndex, &entryName, &length)) {
+        REQUIRE(block.find(entryName, length) == rootIndex);
+        count++;
+    }
+    REQUIRE(count == block.getCount());
+
+    REQUIRE(DirectoryBlock::hashName("abc", 3) == DirectoryBlock::hashName("abcd", 3));
+    delete[] data;
+}
+
+// reads a whole file through the file system and compares it with content
+static void readBack(MyFS *fs, const char *path, const char *content, size_t size) {
+    struct fuse_file_info fileInfo = {};
+    REQUIRE(fs->fuseOpen(path, &fileInfo) == 0);
+    char *r = new char[size + 1];
+    size_t offset = 0;
+    int ret;
+    while ((ret = fs->fuseRead(path, r + offset, size + 1 - offset, offset, &fileInfo)) > 0) {
+        offset += ret;
+    }
+    REQUIRE(ret == 0);
+    REQUIRE(offset == size);
+    REQUIRE(memcmp(r, content, size) == 0);
+    REQUIRE(fs->fuseRelease(path, &fileInfo) == 0);
+    delete[] r;
+}
+
+TEST_CASE( "MYFS_DELAYED_WRITE", "[myfs]" ) {
+
+    char *seed = new char[BLOCK_SIZE * 4];
+    gen_random(seed, BLOCK_SIZE * 4);
+    makeContainer("/tmp/myfs-delayed-write", seed, BLOCK_SIZE * 4);
+    MyFS *fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-delayed-write/container.bin", "/tmp/myfs-delayed-write/log.txt") == 0);
+
+    // appended content is buffered, no data block is assigned while the file is written
+    size_t size = 40 * BLOCK_SIZE + 100;
+    char *w = new char[size];
+    gen_random(w, size);
+    REQUIRE(fs->fuseMkNod("/append.bin", S_IFREG | 0644, 0) == 0);
+    struct fuse_file_info fileInfo = {};
+    REQUIRE(fs->fuseOpen("/append.bin", &fileInfo) == 0);
+    for (size_t offset = 0; offset < size; offset += 1000) {
+        size_t chunk = size - offset < 1000 ? size - offset : 1000;
+        REQUIRE(fs->fuseWrite("/append.bin", w + offset, chunk, offset, &fileInfo) == (int) chunk);
+    }
+    int rootIndex = fs->findFile("/append.bin");
+    REQUIRE(rootIndex >= 0);
+    REQUIRE(fs->getDataBlockCount(rootIndex) == 0);
+
+    // the release assigns the data blocks as one contiguous run
+    REQUIRE(fs->fuseRelease("/append.bin", &fileInfo) == 0);
+    unsigned int count = (size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int *blocks = new int[count];
+    REQUIRE(fs->getDataBlockCount(rootIndex) == count);
+    REQUIRE(fs->getDataBlocks(rootIndex, 0, count, blocks) == count);
+    for (unsigned int i = 1; i < count; i++) {
+        REQUIRE(blocks[i] == blocks[0] + (int) i);
+    }
+    readBack(fs, "/append.bin", w, size);
+    readBack(fs, "/seed.bin", seed, BLOCK_SIZE * 4);
+
+    // content still buffered at the unmount is written
+    REQUIRE(fs->fuseOpen("/append.bin", &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite("/append.bin", w, 1000, size, &fileInfo) == 1000);
+    fs->fuseDestroy();
+    delete fs;
+
+    fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-delayed-write/container.bin", "/tmp/myfs-delayed-write/log.txt") == 0);
+    char *expected = new char[size + 1000];
+    memcpy(expected, w, size);
+    memcpy(expected + size, w, 1000);
+    readBack(fs, "/append.bin", expected, size + 1000);
+    fs->fuseDestroy();
+    delete fs;
+
+    delete[] seed;
+    delete[] w;
+    delete[] blocks;
+    delete[] expected;
+}
+
+TEST_CASE( "MYFS_DIRTY_META_DATA", "[myfs]" ) {
+
+    char *seed = new char[BLOCK_SIZE * 4];
+    gen_random(seed, BLOCK_SIZE * 4);
+    makeContainer("/tmp/myfs-dirty-meta-data", seed, BLOCK_SIZE * 4);
+    MyFS *fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-dirty-meta-data/container.bin", "/tmp/myfs-dirty-meta-data/log.txt") == 0);
+    REQUIRE(fs->writeMetaData() == 0);
+    uint64_t written = fs->getMetaDataBlocksWritten();
+
+    // nothing changed, nothing is written
+    REQUIRE(fs->writeMetaData() == 0);
+    REQUIRE(fs->getMetaDataBlocksWritten() == written);
+
+    // overwriting content changes one inode, only its inode table block is written
+    struct fuse_file_info fileInfo = {};
+    REQUIRE(fs->fuseOpen("/seed.bin", &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite("/seed.bin", "changed", 7, BLOCK_SIZE, &fileInfo) == 7);
+    REQUIRE(fs->fuseRelease("/seed.bin", &fileInfo) == 0);
+    REQUIRE(fs->writeMetaData() == 0);
+    REQUIRE(fs->getMetaDataBlocksWritten() == written + 1);
+    written = fs->getMetaDataBlocksWritten();
+
+    // a new file touches the superBlock, one DMap block, at most two fat blocks, at most two inode table blocks
+    // and one directory block, not the whole DMap and fat
+    char *w = new char[BLOCK_SIZE * 3];
+    gen_random(w, BLOCK_SIZE * 3);
+    REQUIRE(fs->fuseMkNod("/new.bin", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseOpen("/new.bin", &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite("/new.bin", w, BLOCK_SIZE * 3, 0, &fileInfo) == BLOCK_SIZE * 3);
+    REQUIRE(fs->fuseRelease("/new.bin", &fileInfo) == 0);
+    REQUIRE(fs->writeMetaData() == 0);
+    REQUIRE(fs->getMetaDataBlocksWritten() > written);
+    REQUIRE(fs->getMetaDataBlocksWritten() <= written + 7);
+    fs->fuseDestroy();
+    delete fs;
+
+    // the written blocks hold all changes
+    memcpy(seed + BLOCK_SIZE, "changed", 7);
+    fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-dirty-meta-data/container.bin", "/tmp/myfs-dirty-meta-data/log.txt") == 0);
+    readBack(fs, "/seed.bin", seed, BLOCK_SIZE * 4);
+    readBack(fs, "/new.bin", w, BLOCK_SIZE * 3);
+    fs->fuseDestroy();
+    delete fs;
+
+    delete[] seed;
+    delete[] w;
+}
+
+TEST_CASE( "MYFS_INODE_TABLE", "[myfs]" ) {
+
+    char seed[BLOCK_SIZE];
+    gen_random(seed, BLOCK_SIZE);
+    makeContainer("/tmp/myfs-inode-table", seed, BLOCK_SIZE);
+    MyFS *fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-inode-table/container.bin", "/tmp/myfs-inode-table/log.txt") == 0);
+
+    // new inodes are appended, the inode table grows past INODE_TABLE_GROWTH blocks
+    char path[32];
+    std::vector<int> rootIndexes;
+    while (fs->getDataBlockCount(INODE_TABLE) <= INODE_TABLE_GROWTH) {
+        sprintf(path, "/file-%u", (unsigned int) rootIndexes.size());
+        REQUIRE(fs->fuseMkNod(path, S_IFREG | 0644, 0) == 0);
+        rootIndexes.push_back(fs->findFile(path));
+        if (rootIndexes.size() > 1) {
+            REQUIRE(rootIndexes.back() == rootIndexes[rootIndexes.size() - 2] + 1);
+        }
+    }
+    unsigned int tableBlocks = fs->getDataBlockCount(INODE_TABLE);
+    size_t created = rootIndexes.size();
+
+    // released inodes are reused last in, first out, the inode table does not grow
+    REQUIRE(fs->fuseUnlink("/file-3") == 0);
+    REQUIRE(fs->fuseUnlink("/file-100") == 0);
+    REQUIRE(fs->fuseUnlink("/file-7") == 0);
+    REQUIRE(fs->fuseMkNod("/reused-0", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMkNod("/reused-1", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->findFile("/reused-0") == rootIndexes[7]);
+    REQUIRE(fs->findFile("/reused-1") == rootIndexes[100]);
+    REQUIRE(fs->getDataBlockCount(INODE_TABLE) == tableBlocks);
+
+    // the free list and the grown table survive a remount
+    sprintf(path, "/file-%u", (unsigned int) created - 1);
+    REQUIRE(fs->fuseUnlink(path) == 0);
+    fs->fuseDestroy();
+    delete fs;
+    fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-inode-table/container.bin", "/tmp/myfs-inode-table/log.txt") == 0);
+    REQUIRE(fs->getDataBlockCount(INODE_TABLE) == tableBlocks);
+    REQUIRE(fs->findFile(path) == -ENOENT);
+    sprintf(path, "/file-%u", (unsigned int) created - 2);
+    REQUIRE(fs->findFile(path) == rootIndexes[created - 2]);
+    REQUIRE(fs->fuseMkNod("/reused-2", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMkNod("/reused-3", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->fuseMkNod("/appended", S_IFREG | 0644, 0) == 0);
+    REQUIRE(fs->findFile("/reused-2") == rootIndexes[created - 1]);
+    REQUIRE(fs->findFile("/reused-3") == rootIndexes[3]);
+    REQUIRE(fs->findFile("/appended") == rootIndexes[created - 1] + 1);
+    readBack(fs, "/seed.bin", seed, BLOCK_SIZE);
+    fs->fuseDestroy();
+    delete fs;
+}
+
+TEST_CASE( "MYFS_LAZY_FAT", "[myfs]" ) {
+
+    // the file spans several fat blocks, none of them is read by the mount
+    unsigned int count = 3 * BLOCK_SIZE / sizeof(int);
+    size_t size = (size_t) count * BLOCK_SIZE;
+    char *seed = new char[size + BLOCK_SIZE];
+    gen_random(seed, size + BLOCK_SIZE);
+    makeContainer("/tmp/myfs-lazy-fat", seed, size);
+    MyFS *fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-lazy-fat/container.bin", "/tmp/myfs-lazy-fat/log.txt") == 0);
+
+    // the fat chain read on first use matches the extents of the file
+    int rootIndex = fs->findFile("/seed.bin");
+    REQUIRE(rootIndex >= 0);
+    REQUIRE(fs->getDataBlockCount(rootIndex) == count);
+    int *blocks = new int[count + 1];
+    REQUIRE(fs->getDataBlocks(rootIndex, 0, count, blocks) == count);
+    for (unsigned int i = 0; i + 1 < count; i++) {
+        REQUIRE(fs->getFat(blocks[i]) == blocks[i + 1]);
+    }
+    REQUIRE(fs->getFat(blocks[count - 1]) == -1);
+    readBack(fs, "/seed.bin", seed, size);
+
+    // appending changes one fat entry, the other entries of its fat block are written back unchanged
+    struct fuse_file_info fileInfo = {};
+    REQUIRE(fs->fuseOpen("/seed.bin", &fileInfo) == 0);
+    REQUIRE(fs->fuseWrite("/seed.bin", seed + size, BLOCK_SIZE, size, &fileInfo) == BLOCK_SIZE);
+    REQUIRE(fs->fuseRelease("/seed.bin", &fileInfo) == 0);
+    fs->fuseDestroy();
+    delete fs;
+
+    fs = new MyFS();
+    REQUIRE(fs->mountContainer("/tmp/myfs-lazy-fat/container.bin", "/tmp/myfs-lazy-fat/log.txt") == 0);
+    rootIndex = fs->findFile("/seed.bin");
+    REQUIRE(fs->getDataBlocks(rootIndex, 0, count + 1, blocks) == count + 1);
+    unsigned int chained = 1;
+    for (int block = blocks[0]; fs->getFat(block) != -1; block = fs->getFat(block)) {
+        REQUIRE(fs->getFat(block) == blocks[chained]);
+        chained++;
+    }
+    REQUIRE(chained == count + 1);
+    readBack(fs, "/seed.bin", seed, size + BLOCK_SIZE);
+    fs->fuseDestroy();
+    delete fs;
+
+    delete[] seed;
+    delete[] blocks;
+}